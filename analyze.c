@@ -8,37 +8,25 @@
 
 #include "globals.h"
 #include "symtab.h"
+#include "tree.h"
+#include "scan.h"
 #include "analyze.h"
 
-/* Procedure traverse is a generic recursive 
- * syntax tree traversal routine:
- * it applies preProc in preorder and postProc 
- * in postorder to tree pointed to by t
- */
-static void traverse(TreeNode *t,
-	void (*preProc)(TreeNode *),
-	void (*postProc)(TreeNode *)) {
-	if (t != NULL) {
-		preProc(t);
-		{
-			int i;
-			for (i = 0; i < MAXCHILDREN; i++)
-				traverse(t->child[i], preProc, postProc);
-		}
-		postProc(t);
-		traverse(t->sibling, preProc, postProc);
-	}
-}
+/* undeclared is set once a name was not found; as
+   when the types are checked in a walk of their own,
+   no type error is reported after that */
+static int undeclared = FALSE;
 
-/* nullProc is a do-nothing procedure to 
- * generate preorder-only or postorder-only
- * traversals from traverse
- */
-static void nullProc(TreeNode *t) {
-	if (t == NULL)
-		return;
-	else
-		return;
+/* resolve looks the name of t up once, recording its
+   occurrence of the given kind, and leaves its type
+   on t for checkNode; an undeclared name gets -1 */
+static void resolve(TreeNode *t, int kind) {
+	int type = st_resolve(t->attr.sym, t->pos, kind);
+	if (type == -1) {
+		symtabError(t->pos, "undeclared identifier");
+		undeclared = TRUE;
+	}
+	t->type = type;
 }
 
 static void insertNode(TreeNode *t) {
@@ -47,12 +35,7 @@ static void insertNode(TreeNode *t) {
 			switch (t->kind.stmt) {
 				case AssignK:
 				case ReadK:
-					if (st_lookup(t->attr.name) == -1)
-						// not yet in table, so treat as new definition
-						symtabError(t->lineno, "undeclared identifier");
-					else
-						// already in table, so ignore location, add line number of use only
-						st_addline(t->attr.name, t->lineno);
+					resolve(t, OCC_DEF);
 					break;
 				default:
 					break;
@@ -61,12 +44,7 @@ static void insertNode(TreeNode *t) {
 		case ExpK:
 			switch (t->kind.exp) {
 				case IdK:
-					if (st_lookup(t->attr.name) == -1)
-						// not yet in table, so treat as new definition
-						symtabError(t->lineno, "undeclared identifier");
-					else
-						// already in table, so ignore location, add line number of use only
-						st_addline(t->attr.name, t->lineno);
+					resolve(t, OCC_USE);
 					break;
 				default:
 					break;
@@ -77,33 +55,63 @@ static void insertNode(TreeNode *t) {
 	}
 }
 
-/* Function buildSymtab constructs the symbol 
- * table by preorder traversal of the syntax tree
- */
-void buildSymtab(TreeNode *syntaxTree) {
-	traverse(syntaxTree, insertNode, nullProc);
-	if (TraceAnalyze) {
-		fprintf(listing, "\nSymbol table:\n\n");
-		printSymTab(listing);
-	}
-}
+/* the type errors of the walk of analyzeChain,
+   kept to be reported after the symbol table
+   errors, as by a walk of their own */
+typedef struct {
+	int pos;
+	char *message;
+} TypeError;
+static TypeError *pending = NULL;
+static int npending = 0, pendingSize = 0;
+static int deferErrors = FALSE;
 
 static void typeError(TreeNode *t, char *message) {
-	fprintf(listing, "Type error at line %d: %s\n", t->lineno, message);
+	if (undeclared) return;
+	if (deferErrors) {
+		if (npending == pendingSize) {
+			int n = pendingSize ? 2 * pendingSize : 16;
+			TypeError *p = (TypeError *) realloc(pending, n * sizeof(TypeError));
+			if (p == NULL) {
+				fprintf(listing, "Out of memory error\n");
+				Error = TRUE;
+				return;
+			}
+			pending = p;
+			pendingSize = n;
+		}
+		pending[npending].pos = t->pos;
+		pending[npending++].message = message;
+		return;
+	}
+	fprintf(listing, "Type error at line %d, column %d: %s\n", sourceLine(t->pos), sourceColumn(t->pos),
+		message);
 	Error = TRUE;
 }
 
+/* reportTypeErrors reports the kept type errors in
+   the order they were found and forgets them */
+static void reportTypeErrors(void) {
+	int i;
+	for (i = 0; i < npending; i++)
+		fprintf(listing, "Type error at line %d, column %d: %s\n", sourceLine(pending[i].pos),
+			sourceColumn(pending[i].pos), pending[i].message);
+	if (npending > 0) Error = TRUE;
+	npending = 0;
+}
+
 /* Procedure checkNode performs
- * type checking at a single tree node
+ * type checking at a single tree node;
+ * names have their types from insertNode
  */
 static void checkNode(TreeNode *t) {
 	switch (t->nodekind) {
 		case ExpK:
 			switch (t->kind.exp) {
 				case OpK:
-					if (t->attr.op == NOT && t->child[0]->type != Boolean)
+					if (t->attr.op == NOT && nodeChild(t, 0)->type != Boolean)
 						typeError(t, "\'not\' operator needs a boolean expression");
-					else if (t->attr.op != NOT && t->child[0]->type != t->child[1]->type)
+					else if (t->attr.op != NOT && nodeChild(t, 0)->type != nodeChild(t, 1)->type)
 						typeError(t, "the types of operands are not equal");
 					if (t->attr.op == EQ || t->attr.op == LT || t->attr.op == LE || t->attr.op == GT || t->attr.op == GE)
 						t->type = Boolean;
@@ -115,15 +123,15 @@ static void checkNode(TreeNode *t) {
 				case ConstK:
 					t->type = Integer;
 					break;
-				case IdK:
-					t->type = st_gettype(t->attr.name);
-					break;
 				case StrK:
 					t->type = String;
 					break;
 				case BoolK:
 					t->type = Boolean;
 					break;
+				case RefK:
+					t->type = (t - t->attr.val)->type;
+					break;
 				default:
 					break;
 			}
@@ -131,28 +139,24 @@ static void checkNode(TreeNode *t) {
 		case StmtK:
 			switch (t->kind.stmt) {
 				case IfK:
-					if (t->child[0]->type != Boolean)
-						typeError(t->child[0], "if test is not Boolean");
+					if (nodeChild(t, 0)->type != Boolean)
+						typeError(nodeChild(t, 0), "if test is not Boolean");
 					break;
 				case AssignK:
-					t->type = st_gettype(t->attr.name);
-					if (t->child[0]->type != t->type)
-						typeError(t->child[0], "assignment of a different type value");
-					break;
-				case ReadK:
-					t->type = st_gettype(t->attr.name);
+					if (nodeChild(t, 0)->type != t->type)
+						typeError(nodeChild(t, 0), "assignment of a different type value");
 					break;
 				case WriteK:
-					if (t->child[0]->type != Integer)
-						typeError(t->child[0], "write of non-integer value");
+					if (nodeChild(t, 0)->type != Integer)
+						typeError(nodeChild(t, 0), "write of non-integer value");
 					break;
 				case RepeatK:
-					if (t->child[1]->type != Boolean)
-						typeError(t->child[1], "repeat test is not Boolean");
+					if (nodeChild(t, 1)->type != Boolean)
+						typeError(nodeChild(t, 1), "repeat test is not Boolean");
 					break;
 				case WhileK:
-					if (t->child[0]->type != Boolean)
-						typeError(t->child[0], "while test is not Boolean");
+					if (nodeChild(t, 0)->type != Boolean)
+						typeError(nodeChild(t, 0), "while test is not Boolean");
 					break;
 				default:
 					break;
@@ -163,9 +167,71 @@ static void checkNode(TreeNode *t) {
 	}
 }
 
-/* Procedure typeCheck performs type checking 
+/* analyzeChain resolves names in preorder and
+   checks types in postorder in one pass over the
+   records of the chain t, keeping the type errors
+   aside. Preorder is the order of the records; a
+   node is checked once the records of its subtree
+   are passed, from a stack of the nodes open */
+static void analyzeChain(TreeNode *t) {
+	TreeNode *e = chainEnd(t), *next, **open = NULL;
+	int depth = 0, size = 0;
+	npending = 0;
+	undeclared = FALSE;
+	deferErrors = TRUE;
+	for (; t < e; t = next) {
+		while (depth > 0 && open[depth - 1] + open[depth - 1]->size <= t) checkNode(open[--depth]);
+		insertNode(t);
+		next = (t->nodekind == ExpK && t->kind.exp == StrK) ? t + t->size : t + 1;
+		if (next == t + t->size)
+			checkNode(t); /* a leaf */
+		else {
+			if (depth == size) {
+				int n = size ? 2 * size : 64;
+				TreeNode **p = (TreeNode **) realloc(open, n * sizeof(TreeNode *));
+				if (p == NULL) {
+					fprintf(listing, "Out of memory error\n");
+					Error = TRUE;
+					break;
+				}
+				open = p;
+				size = n;
+			}
+			open[depth++] = t;
+		}
+	}
+	while (depth > 0) checkNode(open[--depth]);
+	deferErrors = FALSE;
+	free(open);
+}
+
+/* Function buildSymtab constructs the symbol
+ * table by preorder traversal of the syntax tree
+ */
+void buildSymtab(TreeNode *syntaxTree) {
+	TreeVisitor v = {insertNode, NULL, NULL};
+	undeclared = FALSE;
+	walkTree(syntaxTree, &v);
+	if (TraceAnalyze) {
+		fprintf(listing, "\nSymbol table:\n\n");
+		printSymTab(listing);
+	}
+}
+
+/* Procedure typeCheck performs type checking
  * by a postorder syntax tree traversal
  */
 void typeCheck(TreeNode *syntaxTree) {
-	traverse(syntaxTree, nullProc, checkNode);
+	TreeVisitor v = {NULL, NULL, checkNode};
+	walkTree(syntaxTree, &v);
+}
+
+void analyze(TreeNode *t) {
+	analyzeChain(t);
+	if (!Error)
+		reportTypeErrors();
+	else
+		npending = 0;
 }
+
+const TreeVisitor analyzeVisitor = {insertNode, NULL, checkNode};
@@ -18,4 +18,18 @@ void buildSymtab(TreeNode *);
  */
 void typeCheck(TreeNode *);
 
+/* Procedure analyze does the work of both in one
+ * walk over the chain of statements t, reporting
+ * the symbol table errors and then, if there were
+ * none, the type errors
+ */
+void analyze(TreeNode *t);
+
+/* analyzeVisitor records the uses of names in
+ * preorder and checks types in postorder in one
+ * walk; the one-pass parser applies it to each
+ * statement as soon as it has seen it
+ */
+extern const TreeVisitor analyzeVisitor;
+
 #endif
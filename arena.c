@@ -0,0 +1,128 @@
+/****************************************************/
+/* File: arena.c                                    */
+/* Compilation-scoped arena allocator for the TINY  */
+/* compiler: a bump pointer over a list of large    */
+/* chunks, optionally backed by huge pages          */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "arena.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+/* set ARENA_HUGEPAGES to TRUE to map the chunks
+ * with huge pages where the system offers them
+ */
+#ifndef ARENA_HUGEPAGES
+#define ARENA_HUGEPAGES FALSE
+#endif
+
+/* ARENACHUNK is the size of a chunk, one 2MB huge
+   page; larger requests get a chunk of their own */
+#define ARENACHUNK (2 * 1024 * 1024)
+
+/* ALIGN is the alignment of every allocation */
+#define ALIGN 16
+
+typedef struct ChunkRec {
+	struct ChunkRec *next;
+	size_t size; /* bytes usable after the header */
+} Chunk;
+
+#define HEADER ((sizeof(Chunk) + ALIGN - 1) & ~(size_t) (ALIGN - 1))
+
+/* the chunks in order of use; cur is the one being
+   filled and [ptr, limit) its free space */
+static Chunk *first = NULL, *cur = NULL;
+static char *ptr = NULL, *limit = NULL;
+static unsigned epoch = 1;
+
+/* the adopted blocks, listed in the arena itself */
+typedef struct AdoptedRec {
+	struct AdoptedRec *next;
+	void *block;
+} Adopted;
+
+static Adopted *adopted = NULL;
+
+/* newChunk obtains a chunk with room for n bytes */
+static Chunk *newChunk(size_t n) {
+	size_t size = HEADER + (n > ARENACHUNK - HEADER ? n : ARENACHUNK - HEADER);
+	Chunk *c = NULL;
+#if ARENA_HUGEPAGES && defined(HAVE_MMAP)
+	void *p = MAP_FAILED;
+	size = (size + ARENACHUNK - 1) & ~(size_t) (ARENACHUNK - 1);
+#ifdef MAP_HUGETLB
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if (p == MAP_FAILED) {
+		/* no reserved huge pages: ask for transparent ones */
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+		if (p != MAP_FAILED) madvise(p, size, MADV_HUGEPAGE);
+#endif
+	}
+	if (p != MAP_FAILED) c = (Chunk *) p;
+#endif
+	if (c == NULL) c = (Chunk *) malloc(size);
+	if (c == NULL) return NULL;
+	c->next = NULL;
+	c->size = size - HEADER;
+	return c;
+}
+
+/* nextChunk moves on to a chunk with room for n
+   bytes: the next kept chunk if it is big enough,
+   otherwise a new one linked in after cur */
+static int nextChunk(size_t n) {
+	Chunk *c = (cur == NULL) ? first : cur->next;
+	if (c == NULL || c->size < n) {
+		Chunk *d = newChunk(n);
+		if (d == NULL) return FALSE;
+		d->next = c;
+		if (cur == NULL)
+			first = d;
+		else
+			cur->next = d;
+		c = d;
+	}
+	cur = c;
+	ptr = (char *) c + HEADER;
+	limit = ptr + c->size;
+	return TRUE;
+}
+
+void *arenaAlloc(size_t n) {
+	char *p;
+	n = (n + ALIGN - 1) & ~(size_t) (ALIGN - 1);
+	if (n > (size_t) (limit - ptr) && !nextChunk(n)) return NULL;
+	p = ptr;
+	ptr += n;
+	return p;
+}
+
+int arenaAdopt(void *p) {
+	Adopted *a = (Adopted *) arenaAlloc(sizeof(Adopted));
+	if (a == NULL) return FALSE;
+	a->block = p;
+	a->next = adopted;
+	adopted = a;
+	return TRUE;
+}
+
+void arenaReset(void) {
+	/* the list lives in chunks that stay mapped */
+	for (; adopted != NULL; adopted = adopted->next) free(adopted->block);
+	cur = NULL;
+	ptr = limit = NULL;
+	epoch++;
+}
+
+unsigned arenaEpoch(void) {
+	return epoch;
+}
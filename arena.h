@@ -0,0 +1,39 @@
+/****************************************************/
+/* File: arena.h                                    */
+/* Compilation-scoped arena allocator for the TINY  */
+/* compiler                                         */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+/* Function arenaAlloc returns n bytes, aligned for
+ * any type, from the arena of the current
+ * compilation, or NULL if out of memory; the
+ * memory is never freed on its own
+ */
+void *arenaAlloc(size_t n);
+
+/* Function arenaAdopt hands the malloc'd block p
+ * over to the arena, to be freed by the next
+ * arenaReset; FALSE if out of memory. Large arrays
+ * grown with realloc are adopted rather than copied.
+ */
+int arenaAdopt(void *p);
+
+/* Procedure arenaReset releases everything allocated
+ * from the arena in O(1), besides freeing the adopted
+ * blocks, at the end of a compilation; the chunks
+ * are kept for the next one
+ */
+void arenaReset(void);
+
+/* Function arenaEpoch returns a number that changes
+ * with each arenaReset, so that modules caching
+ * arena memory can tell it has gone
+ */
+unsigned arenaEpoch(void);
+
+#endif
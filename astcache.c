@@ -0,0 +1,342 @@
+/****************************************************/
+/* File: astcache.c                                 */
+/* Cache of checked syntax trees for the TINY       */
+/* compiler                                         */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "intern.h"
+#include "tree.h"
+#include "symtab.h"
+#include "astcache.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* MAGIC starts every cache file; its last character
+   is the version of the layout below */
+#define MAGIC "TINYAST2"
+
+/* ORDER is written as a number so that a cache from
+   a machine of the other byte order is refused */
+#define ORDER 0x01020304
+
+/* The cache file is a CacheHeader, then the tree as
+   records records, then the interned names in id
+   order, each NUL-terminated, padded to nameBytes,
+   and last the symbol table as st_save writes it */
+typedef struct {
+	char magic[8];
+	unsigned order;
+	unsigned record;	/* sizeof(TreeNode) */
+	unsigned shared;	/* ShareExps of the compilation */
+	unsigned records;	/* records in the tree */
+	unsigned names;		/* interned names */
+	unsigned nameBytes; /* bytes of names, a multiple of 4 */
+	unsigned long long srcLen;
+	unsigned long long hash; /* textHash of the source */
+} CacheHeader;
+
+/* the cache file loaded by loadAstCache: mapped if
+   cacheMapped, else read into a malloc'd block */
+static char *cacheData = NULL;
+static size_t cacheLen = 0;
+static int cacheMapped = FALSE;
+
+/* textHash is a 64-bit hash of the source text; it
+   takes eight bytes at a time, so that checking the
+   cache costs far less than scanning the source */
+static unsigned long long textHash(const char *s, size_t len) {
+	unsigned long long h = 0x9e3779b97f4a7c15ULL ^ len, w;
+	size_t i;
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&w, s + i, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	w = 0;
+	memcpy(&w, s + i, len - i);
+	h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	return h ^ (h >> 33);
+}
+
+/* cachePath returns pgm with suffix appended, in
+   a malloc'd string, or NULL if out of memory */
+static char *cachePath(const char *pgm, const char *suffix) {
+	char *path = (char *) malloc(strlen(pgm) + strlen(suffix) + 1);
+	if (path != NULL) {
+		strcpy(path, pgm);
+		strcat(path, suffix);
+	}
+	return path;
+}
+
+/* readCache loads the file path into cacheData;
+   FALSE if there is none or it cannot be read */
+static int readCache(const char *path) {
+	FILE *f;
+	long n;
+#ifdef HAVE_MMAP
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return FALSE;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			close(fd);
+			cacheData = (char *) p;
+			cacheLen = (size_t) st.st_size;
+			cacheMapped = TRUE;
+			return TRUE;
+		}
+	}
+	close(fd);
+#endif
+	f = fopen(path, "rb");
+	if (f == NULL) return FALSE;
+	if (fseek(f, 0, SEEK_END) == 0 && (n = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0 &&
+		(cacheData = (char *) malloc((size_t) n)) != NULL) {
+		cacheLen = fread(cacheData, 1, (size_t) n, f);
+		cacheMapped = FALSE;
+	}
+	fclose(f);
+	return cacheData != NULL;
+}
+
+void closeAstCache(void) {
+#ifdef HAVE_MMAP
+	if (cacheMapped)
+		munmap(cacheData, cacheLen);
+	else
+#endif
+		free(cacheData);
+	cacheData = NULL;
+	cacheLen = 0;
+	cacheMapped = FALSE;
+}
+
+/* CheckFrame is a node whose children checkRecords
+   is going through: next is the record where the
+   next chain starts, end the end of the subtree,
+   slot the slot of the chain under way and more
+   whether it goes on past next */
+typedef struct {
+	TreeNode *t;
+	TreeNode *next, *end;
+	int slot, more;
+} CheckFrame;
+
+/* isOperator tells whether op can be the operator of
+   an OpK */
+static int isOperator(int op) {
+	switch (op) {
+		case PLUS:
+		case MINUS:
+		case TIMES:
+		case OVER:
+		case AND:
+		case OR:
+		case NOT:
+		case LT:
+		case LE:
+		case EQ:
+		case GT:
+		case GE:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/* checkRecords tells whether the n records at r make
+   a tree the listing, the code generator and walkTree
+   can go over safely: kinds, operators and names in
+   range, every chain ending where its subtree says,
+   the text of each StrK ending in a NUL inside it,
+   and each RefK standing for an expression before
+   it. The cache hash covers the source only, so its
+   body is checked before any use. */
+static int checkRecords(TreeNode *r, unsigned n, unsigned names) {
+	CheckFrame *stack;
+	unsigned char *isNode = (unsigned char *) calloc(n, 1);
+	int depth = 1, size = 64, ok = FALSE;
+	stack = (CheckFrame *) malloc(size * sizeof(CheckFrame));
+	if (stack == NULL || isNode == NULL) goto done;
+	/* the program is one chain, as if in a slot */
+	stack[0].t = NULL;
+	stack[0].next = r;
+	stack[0].end = r + n;
+	stack[0].slot = 0;
+	stack[0].more = TRUE;
+	while (depth > 0) {
+		CheckFrame *f = &stack[depth - 1];
+		TreeNode *c = f->next;
+		if (!f->more) {
+			/* on to the next filled slot, if any */
+			while (f->t != NULL && ++f->slot < MAXCHILDREN && !(f->t->flags & CHILD(f->slot)))
+				;
+			if (f->t != NULL && f->slot < MAXCHILDREN)
+				f->more = TRUE;
+			else if (f->next != f->end)
+				goto done;
+			else
+				depth--;
+			continue;
+		}
+		if (c >= f->end || c->size < 1 || c->size > (unsigned) (f->end - c)) goto done;
+		if (c->flags & ~(SIBLING | SHARED | CHILD(0) | CHILD(1) | CHILD(2))) goto done;
+		isNode[c - r] = TRUE;
+		f->next = c + c->size;
+		f->more = (c->flags & SIBLING) != 0;
+		if (c->nodekind == StmtK) {
+			if (c->kind.stmt > WhileK) goto done;
+			if ((c->kind.stmt == AssignK || c->kind.stmt == ReadK) &&
+				(c->attr.sym < 1 || c->attr.sym > names))
+				goto done;
+		} else if (c->nodekind == ExpK) {
+			switch (c->kind.exp) {
+				case OpK:
+					if (!isOperator(c->attr.op)) goto done;
+					break;
+				case IdK:
+					if (c->attr.sym < 1 || c->attr.sym > names) goto done;
+					break;
+				case StrK:
+					if (c->attr.val < 0 || c->size != 1 + textRecords((unsigned) c->attr.val) ||
+						nodeText(c)[c->attr.val] != '\0' || (c->flags & ~(SIBLING | SHARED)))
+						goto done;
+					continue;
+				case RefK:
+					if (c->attr.val < 1 || c->attr.val > c - r || !isNode[c - r - c->attr.val] ||
+						(c - c->attr.val)->nodekind != ExpK)
+						goto done;
+					break;
+				case ConstK:
+				case BoolK:
+					break;
+				default:
+					goto done;
+			}
+		} else
+			goto done;
+		if (!(c->flags & (CHILD(0) | CHILD(1) | CHILD(2)))) {
+			if (c->size != 1) goto done;
+			continue;
+		}
+		if (depth == size) {
+			CheckFrame *p = (CheckFrame *) realloc(stack, 2 * size * sizeof(CheckFrame));
+			if (p == NULL) goto done;
+			stack = p;
+			size *= 2;
+		}
+		f = &stack[depth++];
+		f->t = c;
+		f->next = c + 1;
+		f->end = c + c->size;
+		f->slot = -1;
+		f->more = FALSE;
+	}
+	ok = TRUE;
+done:
+	free(stack);
+	free(isNode);
+	return ok;
+}
+
+/* Function loadAstCache returns the checked tree
+ * cached for pgm if the cache was written for the
+ * source text [text, text + len), with the names and
+ * the symbol table restored, or NULL on a miss
+ */
+TreeNode *loadAstCache(const char *pgm, const char *text, size_t len) {
+	char *path = cachePath(pgm, ".ast");
+	const char *names, *end, *s;
+	CacheHeader h;
+	size_t size;
+	unsigned i;
+	int ok = path != NULL && readCache(path);
+	free(path);
+	if (!ok) return NULL;
+	if (cacheLen < sizeof h) goto miss;
+	memcpy(&h, cacheData, sizeof h);
+	if (memcmp(h.magic, MAGIC, sizeof h.magic) != 0 || h.order != ORDER ||
+		h.record != sizeof(TreeNode) || h.shared != (unsigned) ShareExps ||
+		h.records == 0 || h.srcLen != len || h.hash != textHash(text, len))
+		goto miss;
+	size = sizeof h + (size_t) h.records * sizeof(TreeNode);
+	if (size > cacheLen || h.nameBytes > cacheLen - size || symCount() != 0) goto miss;
+	names = cacheData + size;
+	end = names + h.nameBytes;
+	/* check every name is there before interning any */
+	for (s = names, i = 0; i < h.names; i++, s++) {
+		while (s < end && *s != '\0') s++;
+		if (s == end) goto miss;
+	}
+	for (s = names, i = 1; i <= h.names; i++) {
+		int n = (int) strlen(s);
+		if (internName(s, n, nameHash(s, n)) != (SymId) i) goto miss;
+		s += n + 1;
+	}
+	if (!checkRecords((TreeNode *) (cacheData + sizeof h), h.records, h.names) ||
+		!st_restore(end, cacheData + cacheLen))
+		goto miss;
+	return (TreeNode *) (cacheData + sizeof h);
+miss:
+	closeAstCache();
+	return NULL;
+}
+
+/* Procedure saveAstCache writes the checked tree t
+ * of pgm, the names and the symbol table to the
+ * cache of pgm, by way of a temporary file so that
+ * a cache is never seen half written
+ */
+void saveAstCache(const char *pgm, const char *text, size_t len, TreeNode *t) {
+	static const char pad[4] = {0};
+	char *path, *tmp;
+	FILE *f;
+	CacheHeader h;
+	int i, n = symCount();
+	size_t bytes = 0;
+	if (t == NULL || text == NULL) return;
+	path = cachePath(pgm, ".ast");
+	tmp = cachePath(pgm, ".ast.tmp");
+	f = (path && tmp) ? fopen(tmp, "wb") : NULL;
+	if (f != NULL) {
+		memset(&h, 0, sizeof h);
+		memcpy(h.magic, MAGIC, sizeof h.magic);
+		h.order = ORDER;
+		h.record = sizeof(TreeNode);
+		h.shared = (unsigned) ShareExps;
+		h.records = (unsigned) (chainEnd(t) - t);
+		h.names = (unsigned) n;
+		for (i = 1; i <= n; i++) bytes += strlen(symName(i)) + 1;
+		h.nameBytes = (unsigned) ((bytes + 3) & ~(size_t) 3);
+		h.srcLen = len;
+		h.hash = textHash(text, len);
+		fwrite(&h, sizeof h, 1, f);
+		fwrite(t, sizeof(TreeNode), h.records, f);
+		for (i = 1; i <= n; i++) {
+			char *s = symName(i);
+			fwrite(s, 1, strlen(s) + 1, f);
+		}
+		fwrite(pad, 1, h.nameBytes - bytes, f);
+		st_save(f);
+		if (ferror(f) | (fclose(f) != 0))
+			remove(tmp);
+		else if (rename(tmp, path) != 0) {
+			/* rename does not replace a file everywhere */
+			remove(path);
+			if (rename(tmp, path) != 0) remove(tmp);
+		}
+	}
+	free(path);
+	free(tmp);
+}
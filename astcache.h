@@ -0,0 +1,42 @@
+/****************************************************/
+/* File: astcache.h                                 */
+/* Cache of checked syntax trees for the TINY       */
+/* compiler                                         */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _ASTCACHE_H_
+#define _ASTCACHE_H_
+
+/* The cache of a source file pgm is the file pgm.ast
+ * next to it. It holds the type-checked tree, the
+ * interned names and the symbol table of the last
+ * clean compilation, keyed by a hash of the source
+ * text, and is only good on the machine and build
+ * that wrote it.
+ */
+
+/* Function loadAstCache returns the checked tree
+ * cached for pgm if the cache was written for the
+ * source text [text, text + len), with the names and
+ * the symbol table restored; the tree is mapped from
+ * the cache file as it is. It returns NULL on a miss,
+ * having changed nothing. It must come before
+ * anything is interned.
+ */
+TreeNode *loadAstCache(const char *pgm, const char *text, size_t len);
+
+/* Procedure saveAstCache writes the checked tree t
+ * of pgm, the names and the symbol table to the
+ * cache of pgm; a cache that cannot be written is
+ * left alone
+ */
+void saveAstCache(const char *pgm, const char *text, size_t len, TreeNode *t);
+
+/* Procedure closeAstCache releases the tree
+ * returned by loadAstCache
+ */
+void closeAstCache(void);
+
+#endif
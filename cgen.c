@@ -9,217 +9,383 @@
 
 #include "globals.h"
 #include "symtab.h"
+#include "tree.h"
 #include "code.h"
 #include "cgen.h"
+#include "intern.h"
+#include "arena.h"
 
-static char *temp_v;
+/* Value is the name that holds the value of an
+ * expression already generated: a variable, a
+ * temporary, or a constant formatted into buf.
+ * Names are used in place, so they may be of any
+ * length; name is NULL when the text is in buf, so
+ * that values can move with the stacks that hold
+ * them.
+ */
+typedef struct {
+	char *name;
+	char buf[12];
+} Value;
 
-/* prototype for internal recursive code generator */
-static void cGen(TreeNode *tree);
+/* valueName is the text of the value v */
+#define valueName(v) ((v)->name != NULL ? (v)->name : (v)->buf)
 
-/* Procedure genStmt generates code at a statement node */
-static void genStmt(TreeNode *tree) {
-	char temp[256];
-	char *label;
-	TreeNode *p1, *p2, *p3;
-	int savedLoc1, savedLoc2;
+/* the values generated and not yet used, last on
+   top; a node's operands are the top ones */
+static Value *values = NULL;
+static int nvalues = 0, valuesSize = 0;
+
+/* Pending is an if, repeat or while statement whose
+   code is under way */
+typedef struct {
+	Value test;		/* value of its test */
+	char *label;	/* where a loop jumps back to */
+	int savedLoc1;	/* jump past the then part or body */
+	int savedLoc2;	/* jump past the else part */
+} Pending;
+
+/* the statements under way, innermost on top */
+static Pending *pending = NULL;
+static int npending = 0, pendingSize = 0;
+
+/* SharedValue is the value of an expression that
+   RefKs stand for (see globals.h); they come in the
+   order of their records, for binary search */
+typedef struct {
+	TreeNode *t;
+	Value v;
+} SharedValue;
+
+static SharedValue *shared = NULL;
+static int nshared = 0, sharedSize = 0;
+
+/* pushValue returns a new value on top of the
+   stack, or NULL if out of memory */
+static Value *pushValue(void) {
+	if (nvalues == valuesSize) {
+		int n = valuesSize ? 2 * valuesSize : 64;
+		Value *p = (Value *) realloc(values, n * sizeof(Value));
+		if (p == NULL) return NULL;
+		values = p;
+		valuesSize = n;
+	}
+	return &values[nvalues++];
+}
+
+/* popValue moves the top value into v; an operand
+   that is missing from the tree reads as "" */
+static void popValue(TreeNode *t, int i, Value *v) {
+	if (!(t->flags & CHILD(i)) || nvalues == 0) {
+		v->name = "";
+		return;
+	}
+	*v = values[--nvalues];
+}
+
+static Pending *pushPending(void) {
+	if (npending == pendingSize) {
+		int n = pendingSize ? 2 * pendingSize : 64;
+		Pending *p = (Pending *) realloc(pending, n * sizeof(Pending));
+		if (p == NULL) return NULL;
+		pending = p;
+		pendingSize = n;
+	}
+	return &pending[npending++];
+}
+
+/* outOfMemory stops the generation of code */
+static void outOfMemory(void) {
+	fprintf(listing, "Out of memory error\n");
+	Error = TRUE;
+}
+
+/* Procedure genPre generates code on reaching a
+ * node: the loop labels of repeat and while
+ */
+static void genPre(TreeNode *tree) {
+	Pending *p;
+	if (tree->nodekind != StmtK || Error) return;
 	switch (tree->kind.stmt) {
 		case IfK:
-			p1 = tree->child[0];
-			p2 = tree->child[1];
-			p3 = tree->child[2];
-			/* generate code for test expression */
-			if (p1->kind.exp != OpK)
-				if (p1->kind.exp == IdK)
-					strcpy(temp, p1->attr.name);
-				else
-					sprintf(temp, "%d", p1->attr.val);
-			else {
-				cGen(p1);
-				strcpy(temp, temp_v);
+		case RepeatK:
+		case WhileK:
+			if ((p = pushPending()) == NULL) {
+				outOfMemory();
+				return;
 			}
-			savedLoc1 = emitSkip(1);
-			/* recurse on then part */
-			cGen(p2);
-			if (p3 != NULL)
-				savedLoc2 = emitSkip(1);
-			emit("label", "", "", label = newlabel());
-			emitBackup(savedLoc1);
-			emit("j=", temp, "false", label);
-			emitRestore();
-			/* recurse on else part */
-			if (p3 != NULL) {
-				cGen(p3);
+			p->test.name = "";
+			p->label = NULL;
+			if (tree->kind.stmt != IfK)
+				emit("label", "", "", p->label = newlabel());
+			break;
+		default:
+			break;
+	}
+}
+
+/* Procedure genIn generates code between the
+ * children of a statement node: the tests and
+ * jumps of if and while
+ */
+static void genIn(TreeNode *tree, int i) {
+	Pending *p;
+	char *label;
+	if (tree->nodekind != StmtK || Error || npending == 0) return;
+	p = &pending[npending - 1];
+	switch (tree->kind.stmt) {
+		case IfK:
+			if (i == 0) {
+				popValue(tree, 0, &p->test);
+				p->savedLoc1 = emitSkip(1);
+			} else if (i == 1) {
+				if (tree->flags & CHILD(2))
+					p->savedLoc2 = emitSkip(1);
+				emit("label", "", "", label = newlabel());
+				emitBackup(p->savedLoc1);
+				emit("j=", valueName(&p->test), "false", label);
+				emitRestore();
+				free(label);
+			} else if (tree->flags & CHILD(2)) {
 				emit("label", "", "", label = newlabel());
-				emitBackup(savedLoc2);
+				emitBackup(p->savedLoc2);
 				emit("goto", "", "", label);
 				emitRestore();
+				free(label);
 			}
 			break; /* if_k */
 
+		case WhileK:
+			if (i == 0) {
+				popValue(tree, 0, &p->test);
+				p->savedLoc1 = emitSkip(1);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* Procedure genStmt generates code at a statement
+ * node once its children are done
+ */
+static void genStmt(TreeNode *tree) {
+	Value v;
+	char *label;
+	Pending *p = npending ? &pending[npending - 1] : NULL;
+	switch (tree->kind.stmt) {
+		case IfK:
+			npending--;
+			break;
+
 		case RepeatK:
-			p1 = tree->child[0];
-			p2 = tree->child[1];
-			emit("label", "", "", label = newlabel());
-			/* generate code for body */
-			cGen(p1);
-			/* generate code for test */
-			cGen(p2);
-			emit("j=", temp_v, "false", label);
+			popValue(tree, 1, &v);
+			emit("j=", valueName(&v), "false", p->label);
+			free(p->label);
+			npending--;
 			break; /* repeat */
 
 		case WhileK:
-			p1 = tree->child[0];
-			p2 = tree->child[1];
+			emit("goto", "", "", p->label);
 			emit("label", "", "", label = newlabel());
-			cGen(p1);
-			strcpy(temp, temp_v);
-			savedLoc1 = emitSkip(1);
-			cGen(p2);
-			emit("goto", "", "", label);
-			emit("label", "", "", label = newlabel());
-			emitBackup(savedLoc1);
-			emit("j=", temp, "false", label);
+			emitBackup(p->savedLoc1);
+			emit("j=", valueName(&p->test), "false", label);
 			emitRestore();
+			free(label);
+			free(p->label);
+			npending--;
 			break;
 
 		case AssignK:
-			if (tree->child[0]->kind.exp != OpK)
-				if (tree->child[0]->kind.exp == IdK)
-					emit(":=", tree->child[0]->attr.name, "", tree->attr.name);
-				else {
-					sprintf(temp, "%d", tree->child[0]->attr);
-					emit(":=", temp, "", tree->attr.name);
-				}
-			else {
-				cGen(tree->child[0]);
-				emit(":=", temp_v, "", tree->attr.name);
-			}
+			popValue(tree, 0, &v);
+			emit(":=", valueName(&v), "", symName(tree->attr.sym));
 			break; /* assign_k */
 
 		case ReadK:
-			emit("read", "", "", tree->attr.name);
+			emit("read", "", "", symName(tree->attr.sym));
 			break;
 
 		case WriteK:
-			if (tree->child[0]->kind.exp != OpK)
-				if (tree->child[0]->kind.exp == IdK)
-					emit("write", tree->child[0]->attr.name, "", "");
-				else {
-					sprintf(temp, "%d", tree->child[0]->attr.val);
-					emit("write", temp, "", "");
-				}
-			else {
-				cGen(tree->child[0]);
-				emit("write", temp_v, "", "");
-			}
+			popValue(tree, 0, &v);
+			emit("write", valueName(&v), "", "");
 			break;
 		default:
 			break;
 	}
 } /* genStmt */
 
-/* Procedure genExp generates code at an expression node */
+/* Procedure genExp generates code at an expression
+ * node once its operands are done, and leaves the
+ * name of its value on the value stack
+ */
 static void genExp(TreeNode *tree) {
-	char temp[256], temp2[256];
-	TreeNode *p1 = NULL, *p2 = NULL;
+	Value v1, v2;
+	char *temp, *temp2, *result;
+	Value *r;
 	switch (tree->kind.exp) {
 		case OpK:
-			p1 = tree->child[0];
-			if (tree->child[1] != NULL)
-				p2 = tree->child[1];
-
-			if (p1->kind.exp != OpK)
-				if (p1->kind.exp == IdK)
-					strcpy(temp, p1->attr.name);
-				else
-					sprintf(temp, "%d", p1->attr.val);
-			else {
-				cGen(p1);
-				strcpy(temp, temp_v);
-			}
-
-			if (p2 != NULL)
-				if (p2->kind.exp != OpK)
-					if (p2->kind.exp == IdK)
-						strcpy(temp2, p2->attr.name);
-					else
-						sprintf(temp2, "%d", p2->attr.val);
-				else {
-					cGen(p2);
-					strcpy(temp2, temp_v);
-				}
-
-			temp_v = newtemp();
+			popValue(tree, 1, &v2);
+			popValue(tree, 0, &v1);
+			temp = valueName(&v1);
+			temp2 = valueName(&v2);
+			result = newtemp();
 			switch (tree->attr.op) {
 				case PLUS:
-					emit("+", temp, temp2, temp_v);
+					emit("+", temp, temp2, result);
 					break;
 				case MINUS:
-					emit("-", temp, temp2, temp_v);
+					emit("-", temp, temp2, result);
 					break;
 				case TIMES:
-					emit("*", temp, temp2, temp_v);
+					emit("*", temp, temp2, result);
 					break;
 				case OVER:
-					emit("/", temp, temp2, temp_v);
+					emit("/", temp, temp2, result);
 					break;
 				case LT:
-					emit("<", temp, temp2, temp_v);
+					emit("<", temp, temp2, result);
 					break;
 				case LE:
-					emit("<=", temp, temp2, temp_v);
+					emit("<=", temp, temp2, result);
 					break;
 				case GT:
-					emit(">", temp, temp2, temp_v);
+					emit(">", temp, temp2, result);
 					break;
 				case GE:
-					emit(">=", temp, temp2, temp_v);
+					emit(">=", temp, temp2, result);
 					break;
 				case EQ:
-					emit("=", temp, temp2, temp_v);
+					emit("=", temp, temp2, result);
 					break;
 				case AND:
-					emit("and", temp, temp2, temp_v);
+					emit("and", temp, temp2, result);
 					break;
 				case OR:
-					emit("or", temp, temp2, temp_v);
+					emit("or", temp, temp2, result);
 					break;
 				case NOT:
-					emit("not", temp, "", temp_v);
+					emit("not", temp, "", result);
 					break;
 				default:
 					emit("BUG: Unknown operator", "", "", "");
 					break;
 			}	  /* case op */
+			if ((r = pushValue()) == NULL) {
+				outOfMemory();
+				free(result);
+				return;
+			}
+			strcpy(r->buf, result);
+			free(result);
+			r->name = NULL;
+			if (tree->flags & SHARED) {
+				if (nshared == sharedSize) {
+					int n = sharedSize ? 2 * sharedSize : 64;
+					SharedValue *p = (SharedValue *) realloc(shared, n * sizeof(SharedValue));
+					if (p == NULL) {
+						outOfMemory();
+						return;
+					}
+					shared = p;
+					sharedSize = n;
+				}
+				shared[nshared].t = tree;
+				shared[nshared++].v = *r;
+			}
 			break; /* OpK */
 
+		case RefK: {
+			/* the code of the expression is already there */
+			TreeNode *f = tree - tree->attr.val;
+			int lo = 0, hi = nshared - 1, mid;
+			if ((r = pushValue()) == NULL) {
+				outOfMemory();
+				return;
+			}
+			r->name = "";
+			while (lo <= hi) {
+				mid = (lo + hi) / 2;
+				if (shared[mid].t < f)
+					lo = mid + 1;
+				else if (shared[mid].t > f)
+					hi = mid - 1;
+				else {
+					*r = shared[mid].v;
+					break;
+				}
+			}
+			break;
+		}
+
+		case IdK:
+			if ((r = pushValue()) == NULL) {
+				outOfMemory();
+				return;
+			}
+			r->name = symName(tree->attr.sym);
+			break;
+
+		case StrK:
+			/* the quoted text, kept in the arena like the
+			   names, as a string is longer than buf */
+			if ((r = pushValue()) == NULL ||
+				(r->name = (char *) arenaAlloc(strlen(nodeText(tree)) + 3)) == NULL) {
+				outOfMemory();
+				return;
+			}
+			sprintf(r->name, "'%s'", nodeText(tree));
+			break;
+
 		default:
+			if ((r = pushValue()) == NULL) {
+				outOfMemory();
+				return;
+			}
+			sprintf(r->buf, "%d", tree->attr.val);
+			r->name = NULL;
 			break;
 	}
 } /* genExp */
 
-/* Procedure cGen recursively generates code by
- * tree traversal
+/* Procedure genPost generates code at a node once
+ * its children are done
  */
-static void cGen(TreeNode *tree) {
-	if (tree != NULL) {
-		switch (tree->nodekind) {
-			case StmtK:
-				genStmt(tree);
-				break;
-			case ExpK:
-				genExp(tree);
-				break;
-			default:
-				break;
-		}
-		cGen(tree->sibling);
+static void genPost(TreeNode *tree) {
+	if (Error) return;
+	switch (tree->nodekind) {
+		case StmtK:
+			genStmt(tree);
+			break;
+		case ExpK:
+			genExp(tree);
+			break;
+		default:
+			break;
 	}
 }
 
+const TreeVisitor codeGenVisitor = {genPre, genIn, genPost};
+
+/* Procedure codeGen generates code by one walk over
+ * the tree: a node's code comes after that of its
+ * operands, and an if or while statement adds its
+ * jumps between its children
+ */
 void codeGen(TreeNode *syntaxTree) {
-	cGen(syntaxTree);
+	walkTree(syntaxTree, &codeGenVisitor);
+	codeGenFinish();
+}
+
+void codeGenFinish(void) {
+	free(values);
+	free(pending);
+	free(shared);
+	values = NULL;
+	pending = NULL;
+	shared = NULL;
+	nvalues = valuesSize = npending = pendingSize = 0;
+	nshared = sharedSize = 0;
 	emit("label", "", "", "L0");
 	output();
 }
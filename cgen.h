@@ -16,4 +16,16 @@
  */
 void codeGen(TreeNode *syntaxTree);
 
+/* codeGenVisitor holds the actions codeGen walks
+ * the tree with (see tree.h); in one-pass mode the
+ * parser applies them itself, piece by piece, as
+ * it recognizes each statement
+ */
+extern const TreeVisitor codeGenVisitor;
+
+/* Procedure codeGenFinish ends the code generated
+ * so far and writes it to the code file
+ */
+void codeGenFinish(void);
+
 #endif
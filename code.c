@@ -18,73 +18,123 @@ static int emitLoc = 0;
    emitBackup, and emitRestore */
 static int highEmitLoc = 0;
 
-struct {
+/* locations skipped by emitSkip and not yet
+   backpatched */
+static int holes = 0;
+
+typedef struct {
 	char *op;
 	char *a;
 	char *b;
 	char *c;
-} mcode[512];
+} Instr;
+
+/* the instructions from location base on that are
+   not written out yet; mcode[i] is location base + i */
+static Instr *mcode = NULL;
+static int base = 0, mcodeSize = 0;
+
+/* slot returns the instruction at location loc,
+   growing the buffer up to it as needed */
+static Instr *slot(int loc) {
+	if (loc - base >= mcodeSize) {
+		int n = mcodeSize ? 2 * mcodeSize : 512;
+		Instr *p;
+		while (n <= loc - base) n *= 2;
+		p = (Instr *) realloc(mcode, n * sizeof(Instr));
+		if (p == NULL) {
+			fprintf(listing, "Out of memory error\n");
+			Error = TRUE;
+			return NULL;
+		}
+		memset(p + mcodeSize, 0, (n - mcodeSize) * sizeof(Instr));
+		mcode = p;
+		mcodeSize = n;
+	}
+	return &mcode[loc - base];
+}
 
 void emit(char *op, char *a, char *b, char *c) {
-	mcode[emitLoc].op = (char *) malloc(sizeof(char) * (strlen(op) + 1));
-	mcode[emitLoc].a = (char *) malloc(sizeof(char) * (strlen(a) + 1));
-	mcode[emitLoc].b = (char *) malloc(sizeof(char) * (strlen(b) + 1));
-	mcode[emitLoc].c = (char *) malloc(sizeof(char) * (strlen(c) + 1));
-	strcpy(mcode[emitLoc].op, op);
-	strcpy(mcode[emitLoc].a, a);
-	strcpy(mcode[emitLoc].b, b);
-	strcpy(mcode[emitLoc].c, c);
+	Instr *m = slot(emitLoc);
+	if (m == NULL) return;
+	if (emitLoc < highEmitLoc && m->op == NULL) holes--;
+	m->op = (char *) malloc(sizeof(char) * (strlen(op) + 1));
+	m->a = (char *) malloc(sizeof(char) * (strlen(a) + 1));
+	m->b = (char *) malloc(sizeof(char) * (strlen(b) + 1));
+	m->c = (char *) malloc(sizeof(char) * (strlen(c) + 1));
+	strcpy(m->op, op);
+	strcpy(m->a, a);
+	strcpy(m->b, b);
+	strcpy(m->c, c);
 	emitLoc++;
 	if (highEmitLoc < emitLoc)
 		highEmitLoc = emitLoc;
 }
 
-void output() {
+/* writeCode writes out the instructions up to
+   location end and frees them */
+static void writeCode(int end) {
 	int i;
-	for (i = 0; i < highEmitLoc; i++) {
-		if (strcmp(mcode[i].op, "+") == 0 ||
-			strcmp(mcode[i].op, "-") == 0 ||
-			strcmp(mcode[i].op, "*") == 0 ||
-			strcmp(mcode[i].op, "/") == 0 ||
-			strcmp(mcode[i].op, "and") == 0 ||
-			strcmp(mcode[i].op, "or") == 0 ||
-			strcmp(mcode[i].op, "<") == 0 ||
-			strcmp(mcode[i].op, "<=") == 0 ||
-			strcmp(mcode[i].op, ">") == 0 ||
-			strcmp(mcode[i].op, ">=") == 0 ||
-			strcmp(mcode[i].op, "=") == 0)
-			fprintf(code, "%5d)  %s := %s %s %s\n", i, mcode[i].c, mcode[i].a, mcode[i].op, mcode[i].b);
-		else if (strcmp(mcode[i].op, "read") == 0)
-			fprintf(code, "%5d)  %s %s\n", i, mcode[i].op, mcode[i].c);
-		else if (strcmp(mcode[i].op, "write") == 0)
-			fprintf(code, "%5d)  %s %s\n", i, mcode[i].op, mcode[i].a);
-		else if (strcmp(mcode[i].op, ":=") == 0)
-			fprintf(code, "%5d)  %s %s %s\n", i, mcode[i].c, mcode[i].op, mcode[i].a);
-		else if (strcmp(mcode[i].op, "label") == 0 ||
-				 strcmp(mcode[i].op, "goto") == 0)
-			fprintf(code, "%5d)  %s %s\n", i, mcode[i].op, mcode[i].c);
-		else if (strcmp(mcode[i].op, "j=") == 0)
-			fprintf(code, "%5d)  if %s = %s goto %s\n", i, mcode[i].a, mcode[i].b, mcode[i].c);
+	for (i = base; i < end; i++) {
+		Instr *m = &mcode[i - base];
+		if (m->op == NULL)
+			continue;
+		if (strcmp(m->op, "+") == 0 ||
+			strcmp(m->op, "-") == 0 ||
+			strcmp(m->op, "*") == 0 ||
+			strcmp(m->op, "/") == 0 ||
+			strcmp(m->op, "and") == 0 ||
+			strcmp(m->op, "or") == 0 ||
+			strcmp(m->op, "<") == 0 ||
+			strcmp(m->op, "<=") == 0 ||
+			strcmp(m->op, ">") == 0 ||
+			strcmp(m->op, ">=") == 0 ||
+			strcmp(m->op, "=") == 0)
+			fprintf(code, "%5d)  %s := %s %s %s\n", i, m->c, m->a, m->op, m->b);
+		else if (strcmp(m->op, "read") == 0)
+			fprintf(code, "%5d)  %s %s\n", i, m->op, m->c);
+		else if (strcmp(m->op, "write") == 0)
+			fprintf(code, "%5d)  %s %s\n", i, m->op, m->a);
+		else if (strcmp(m->op, ":=") == 0)
+			fprintf(code, "%5d)  %s %s %s\n", i, m->c, m->op, m->a);
+		else if (strcmp(m->op, "label") == 0 ||
+				 strcmp(m->op, "goto") == 0)
+			fprintf(code, "%5d)  %s %s\n", i, m->op, m->c);
+		else if (strcmp(m->op, "j=") == 0)
+			fprintf(code, "%5d)  if %s = %s goto %s\n", i, m->a, m->b, m->c);
+		free(m->op);
+		free(m->a);
+		free(m->b);
+		free(m->c);
+		m->op = NULL;
 	}
 }
 
+void output() {
+	writeCode(highEmitLoc);
+	free(mcode);
+	mcode = NULL;
+	mcodeSize = 0;
+	base = highEmitLoc;
+}
+
+void emitFlush(void) {
+	if (holes > 0 || emitLoc != highEmitLoc || highEmitLoc == base) return;
+	writeCode(highEmitLoc);
+	base = highEmitLoc;
+}
+
 char *newtemp() {
 	static int n = 0;
-	char tmpn[3] = { '\0' };
-	char *temp = (char *) malloc(sizeof(char) * 6);
-	sprintf(tmpn, "%d", n++);
-	strcpy(temp, "t");
-	strcat(temp, tmpn);
+	char *temp = (char *) malloc(sizeof(char) * 12);
+	sprintf(temp, "t%d", n++);
 	return temp;
 }
 
 char *newlabel() {
 	static int n = 1;
-	char *temp = (char *) malloc(sizeof(char) * 4);
-	char tmpn[3] = { '\0' };
-	strcpy(temp, "L");
-	sprintf(tmpn, "%d", n++);
-	strcat(temp, tmpn);
+	char *temp = (char *) malloc(sizeof(char) * 12);
+	sprintf(temp, "L%d", n++);
 	return temp;
 }
 
@@ -95,6 +145,7 @@ char *newlabel() {
 int emitSkip(int howMany) {
 	int i = emitLoc;
 	emitLoc += howMany;
+	holes += howMany;
 	if (highEmitLoc < emitLoc) highEmitLoc = emitLoc;
 	return i;
 } /* emitSkip */
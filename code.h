@@ -34,5 +34,11 @@ void emitBackup(int loc);
  */
 void emitRestore(void);
 
+/* Procedure emitFlush writes out the code emitted
+ * so far, unless part of it still waits for a
+ * backpatch; output writes out the rest
+ */
+void emitFlush(void);
+
 
 #endif
@@ -10,6 +10,7 @@
 #define _GLOBALS_H_
 
 #include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,32 +23,43 @@
 #define TRUE 1
 #endif
 
+/* RESERVED_WORDS lists every reserved word as
+ * X(token, lexeme); the TokenType entries below and
+ * the scanner's keyword hash table (keyhash.h, built
+ * by mkkeys.c) are both generated from this list
+ */
+#define RESERVED_WORDS(X) \
+	X(IF, "if")           \
+	X(THEN, "then")       \
+	X(ELSE, "else")       \
+	X(END, "end")         \
+	X(REPEAT, "repeat")   \
+	X(UNTIL, "until")     \
+	X(READ, "read")       \
+	X(WRITE, "write")     \
+	X(BTRUE, "true")      \
+	X(BFALSE, "false")    \
+	X(OR, "or")           \
+	X(AND, "and")         \
+	X(NOT, "not")         \
+	X(INT, "int")         \
+	X(BOOL, "bool")       \
+	X(STRING, "string")   \
+	X(WHILE, "while")     \
+	X(DO, "do")
+
+#define RESERVED_TOKEN(tok, str) tok,
+#define RESERVED_COUNT(tok, str) +1
+
 /* MAXRESERVED = the number of reserved words */
-#define MAXRESERVED 18
+#define MAXRESERVED (0 RESERVED_WORDS(RESERVED_COUNT))
 
 typedef enum
 /* book-keeping tokens */
 { ENDFILE,
 	ERROR,
 	/* reserved words */
-	IF,
-	THEN,
-	ELSE,
-	END,
-	REPEAT,
-	UNTIL,
-	READ,
-	WRITE,
-	BTRUE,
-	BFALSE,
-	OR,
-	AND,
-	NOT,
-	INT,
-	BOOL,
-	STRING,
-	WHILE,
-	DO,
+	RESERVED_WORDS(RESERVED_TOKEN)
 	/* multicharacter tokens */
 	ID,
 	NUM,
@@ -73,7 +85,25 @@ extern FILE *source;  /* source code text file */
 extern FILE *listing; /* listing output text file */
 extern FILE *code;	/* code text file for TM simulator */
 
-extern int lineno; /* source line number for listing */
+/* THREAD_LOCAL marks the state of which each
+ * thread parsing part of the program keeps its own
+ * copy (see parse.c)
+ */
+#if defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL
+#endif
+
+extern THREAD_LOCAL int lineno; /* source line number for listing */
+
+/* tokenpos is the byte offset in the source of the
+ * current token; tree nodes keep such offsets, and
+ * sourceLine (scan.h) turns them into line numbers
+ */
+extern THREAD_LOCAL int tokenpos;
 
 /**************************************************/
 /***********   Syntax tree for parsing ************/
@@ -91,7 +121,8 @@ typedef enum { OpK,
 	ConstK,
 	IdK,
 	StrK,
-	BoolK } ExpKind;
+	BoolK,
+	RefK } ExpKind;
 
 /* ExpType is used for type checking */
 typedef enum { Void,
@@ -101,23 +132,45 @@ typedef enum { Void,
 
 #define MAXCHILDREN 3
 
+/* SymId is the 32-bit id of an interned identifier
+ * (see intern.h); NOSYM marks a node without one
+ */
+typedef unsigned int SymId;
+#define NOSYM 0
+
+/* The syntax tree is one array of TreeNode records
+ * in preorder: a node is followed by the chains of
+ * its children, in order, and then by its next
+ * sibling. Arity depends on the kind, and flags tells
+ * which child slots are filled; a StrK keeps its text
+ * in the records right after it, and a RefK, which
+ * stands for an expression laid out before it, keeps
+ * in attr.val how many records back that is. See
+ * tree.h.
+ */
 typedef struct treeNode {
-	struct treeNode *child[MAXCHILDREN];
-	struct treeNode *sibling;
-	int lineno;
-	NodeKind nodekind;
+	unsigned char nodekind; /* NodeKind */
 	union {
-		StmtKind stmt;
-		ExpKind exp;
+		unsigned char stmt; /* StmtKind */
+		unsigned char exp;	/* ExpKind */
 	} kind;
+	unsigned char type;	 /* ExpType, for type checking of exps */
+	unsigned char flags; /* CHILD(i) and SIBLING bits */
+	int pos;			 /* byte offset of the token it was built at */
 	union {
 		TokenType op;
-		int val;
-		char *name;
+		int val; /* also the text length of a StrK */
+		SymId sym; /* name of IdK, AssignK, ReadK */
 	} attr;
-	ExpType type; /* for type checking of exps */
+	unsigned int size; /* records in the subtree, this one
+						  included: the 32-bit index of
+						  what follows it */
 } TreeNode;
 
+#define CHILD(i) (1 << (i))
+#define SIBLING (1 << MAXCHILDREN)
+#define SHARED (1 << (MAXCHILDREN + 1)) /* some RefK stands for it */
+
 /**************************************************/
 /***********   Flags for tracing       ************/
 /**************************************************/
@@ -150,6 +203,39 @@ extern int TraceAnalyze;
  */
 extern int TraceCode;
 
+/* ScanWholeFile = TRUE makes the scanner tokenize
+ * the whole source file into a token stream before
+ * parsing starts (--token-stream); the parser then
+ * reads tokens through a cursor over the stream
+ */
+extern int ScanWholeFile;
+
+/* LexThreads > 1 lets the whole-file scan split a
+ * large source into chunks lexed on that many
+ * threads (--lex-threads N)
+ */
+extern int LexThreads;
+
+/* ParseThreads > 1 lets the parser split the
+ * statements of a large program into ranges parsed
+ * on that many threads (--parse-threads N)
+ */
+extern int ParseThreads;
+
+/* ShareExps = TRUE lays out each operator
+ * expression met again within a straight-line
+ * stretch of code, its operands unchanged, as a RefK
+ * back to the first one (--share-exps), so that
+ * code is generated for it once
+ */
+extern int ShareExps;
+
+/* OnePass = TRUE makes the parser check and
+ * generate code for each statement as it is
+ * recognized, building no syntax tree (--one-pass)
+ */
+extern int OnePass;
+
 /* Error = TRUE prevents further passes if an error occurs */
 extern int Error;
 #endif
@@ -0,0 +1,279 @@
+/****************************************************/
+/* File: intern.c                                   */
+/* Identifier interning for the TINY compiler       */
+/* Names and tables live in the compilation arena   */
+/* and are found through an open-addressing table   */
+/* with linear probing, and those of the            */
+/* declarations through a perfect hash              */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "intern.h"
+#include "arena.h"
+
+/* the interned names, indexed by id (entry 0 unused) */
+typedef struct {
+	char *name;
+	int len;
+	unsigned hash;
+} SymEntry;
+
+static SymEntry *syms = NULL;
+static int nsyms = 1, symsSize = 0;
+
+/* the id table, a power of two kept at most half full */
+static SymId *slots = NULL;
+static unsigned slotMask = 0;
+
+/* the names interned by the end of the declarations,
+   which freezeNames turns into a minimal perfect
+   hash, CHD style: the hash of a name picks a bucket,
+   and the displacement of the bucket, chosen when
+   freezing so that no two names meet, picks the one
+   slot the name can be in. The names are copied one
+   after another in slot order. */
+typedef struct {
+	unsigned hash;
+	SymId id;
+	int off, len; /* of the name in frozenText */
+} FrozenSlot;
+static FrozenSlot *frozen = NULL;
+static unsigned *displace = NULL;
+static unsigned nfrozen = 0, nbuckets = 0;
+static char *frozenText = NULL;
+
+/* BUCKET is the average number of names a bucket of
+   the frozen table holds */
+#define BUCKET 4
+
+/* the arena epoch the tables belong to */
+static unsigned epoch = 0;
+
+/* checkEpoch drops the tables once an arenaReset
+   has released them */
+static void checkEpoch(void) {
+	if (epoch != arenaEpoch()) {
+		epoch = arenaEpoch();
+		syms = NULL;
+		nsyms = 1;
+		symsSize = 0;
+		slots = NULL;
+		slotMask = 0;
+		frozen = NULL;
+		displace = NULL;
+		nfrozen = nbuckets = 0;
+		frozenText = NULL;
+	}
+}
+
+unsigned nameHash(const char *s, int len) {
+	unsigned h = 2166136261u; /* FNV-1a */
+	int i;
+	for (i = 0; i < len; i++) h = (h ^ (unsigned char) s[i]) * 16777619u;
+	return h;
+}
+
+char *arenaString(const char *s, int len) {
+	char *t = (char *) arenaAlloc(len + 1);
+	if (t == NULL) return NULL;
+	memcpy(t, s, len);
+	t[len] = '\0';
+	return t;
+}
+
+/* growSlots doubles the id table and rehashes the
+   stored hashes into it */
+static int growSlots(void) {
+	unsigned size = slotMask ? 2 * (slotMask + 1) : 1024, i;
+	SymId *t = (SymId *) arenaAlloc(size * sizeof(SymId));
+	int k;
+	if (t == NULL) return FALSE;
+	memset(t, 0, size * sizeof(SymId));
+	for (k = 1; k < nsyms; k++) {
+		for (i = syms[k].hash & (size - 1); t[i] != NOSYM; i = (i + 1) & (size - 1))
+			;
+		t[i] = (SymId) k;
+	}
+	slots = t;
+	slotMask = size - 1;
+	return TRUE;
+}
+
+/* scale maps x onto [0, n) by its high bits */
+#define scale(x, n) ((unsigned) (((unsigned long long) (x) * (n)) >> 32))
+
+/* slotHash mixes the hash h of a name with the
+   displacement d of its bucket (the finalizer of
+   MurmurHash3); its high bits pick the slot */
+static unsigned slotHash(unsigned h, unsigned d) {
+	h ^= d * 0x9e3779b9u;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+/* frozenSlot is the one slot of the frozen table a
+   name of hash h can be in */
+#define frozenSlot(h) (&frozen[scale(slotHash(h, displace[scale(h, nbuckets)]), nfrozen)])
+
+/* placeBucket finds a displacement that puts the n
+   names keys of bucket b into free slots of taken,
+   and takes them; FALSE if none does */
+static int placeBucket(unsigned b, const SymId *keys, unsigned n, unsigned char *taken) {
+	unsigned d, i, j, limit = 64 * nfrozen + 1024;
+	unsigned slot[64];
+	for (d = 0; d < limit; d++) {
+		for (i = 0; i < n; i++) {
+			slot[i] = scale(slotHash(syms[keys[i]].hash, d), nfrozen);
+			if (taken[slot[i]]) break;
+			taken[slot[i]] = TRUE;
+		}
+		if (i == n) {
+			displace[b] = d;
+			return TRUE;
+		}
+		for (j = 0; j < i; j++) taken[slot[j]] = FALSE;
+	}
+	return FALSE;
+}
+
+void freezeNames(void) {
+	unsigned n, nb, b, i, j, k, off;
+	unsigned *start = NULL, *order = NULL;
+	SymId *keys = NULL;
+	unsigned char *taken = NULL;
+	int ok = FALSE;
+	checkEpoch();
+	n = (unsigned) nsyms - 1;
+	if (n == 0 || frozen != NULL) return;
+	nb = n / BUCKET + 1;
+	nfrozen = n;
+	nbuckets = nb;
+	displace = (unsigned *) arenaAlloc(nb * sizeof(unsigned));
+	start = (unsigned *) calloc(nb + 1, sizeof(unsigned));
+	order = (unsigned *) malloc(nb * sizeof(unsigned));
+	keys = (SymId *) malloc(n * sizeof(SymId));
+	taken = (unsigned char *) calloc(n, 1);
+	if (displace == NULL || start == NULL || order == NULL || keys == NULL || taken == NULL)
+		goto done;
+	/* the names by bucket */
+	for (k = 1; k <= n; k++) start[scale(syms[k].hash, nb) + 1]++;
+	for (b = 0; b < nb; b++) {
+		if (start[b + 1] > 64) goto done;
+		start[b + 1] += start[b];
+	}
+	for (k = 1; k <= n; k++) keys[start[scale(syms[k].hash, nb)]++] = (SymId) k;
+	for (b = nb; b > 0; b--) start[b] = start[b - 1];
+	start[0] = 0;
+	/* names of one hash cannot be told apart */
+	for (b = 0; b < nb; b++)
+		for (i = start[b]; i < start[b + 1]; i++)
+			for (j = i + 1; j < start[b + 1]; j++)
+				if (syms[keys[i]].hash == syms[keys[j]].hash) goto done;
+	/* the fullest buckets first, while most slots
+	   are free */
+	for (b = 0, k = 64; k > 0; k--)
+		for (i = 0; i < nb; i++)
+			if (start[i + 1] - start[i] == k) order[b++] = i;
+	for (i = 0; i < b; i++)
+		if (!placeBucket(order[i], keys + start[order[i]], start[order[i] + 1] - start[order[i]], taken))
+			goto done;
+	frozen = (FrozenSlot *) arenaAlloc(n * sizeof(FrozenSlot));
+	for (off = 0, k = 1; k <= n; k++) off += syms[k].len;
+	frozenText = (char *) arenaAlloc(off ? off : 1);
+	if (frozen == NULL || frozenText == NULL) goto done;
+	for (k = 1; k <= n; k++) {
+		FrozenSlot *f = frozenSlot(syms[k].hash);
+		f->hash = syms[k].hash;
+		f->id = (SymId) k;
+		f->len = syms[k].len;
+	}
+	for (off = 0, k = 0; k < n; k++) {
+		frozen[k].off = off;
+		memcpy(frozenText + off, syms[frozen[k].id].name, frozen[k].len);
+		off += frozen[k].len;
+	}
+	ok = TRUE;
+done:
+	if (!ok) {
+		/* lookups go on through the id table */
+		frozen = NULL;
+		nfrozen = nbuckets = 0;
+	}
+	free(start);
+	free(order);
+	free(keys);
+	free(taken);
+}
+
+SymId internName(const char *s, int len, unsigned hash) {
+	unsigned i;
+	SymId id;
+	checkEpoch();
+	if (frozen != NULL) {
+		FrozenSlot *f = frozenSlot(hash);
+		if (f->hash == hash && f->len == len && memcmp(frozenText + f->off, s, len) == 0)
+			return f->id;
+	}
+	if (slots != NULL)
+		for (i = hash & slotMask; (id = slots[i]) != NOSYM; i = (i + 1) & slotMask)
+			if (syms[id].hash == hash && syms[id].len == len &&
+				memcmp(syms[id].name, s, len) == 0)
+				return id;
+	if (2 * (unsigned) nsyms > slotMask && !growSlots()) return NOSYM;
+	if (nsyms >= symsSize) {
+		int n = symsSize ? 2 * symsSize : 1024;
+		SymEntry *t = (SymEntry *) arenaAlloc(n * sizeof(SymEntry));
+		if (t == NULL) return NOSYM;
+		if (nsyms > 1) memcpy(t, syms, nsyms * sizeof(SymEntry));
+		syms = t;
+		symsSize = n;
+	}
+	id = (SymId) nsyms;
+	syms[id].name = arenaString(s, len);
+	if (syms[id].name == NULL) return NOSYM;
+	syms[id].len = len;
+	syms[id].hash = hash;
+	nsyms++;
+	for (i = hash & slotMask; slots[i] != NOSYM; i = (i + 1) & slotMask)
+		;
+	slots[i] = id;
+	return id;
+}
+
+char *symName(SymId id) {
+	checkEpoch();
+	return (id > 0 && (int) id < nsyms) ? syms[id].name : "";
+}
+
+int symCount(void) {
+	checkEpoch();
+	return nsyms - 1;
+}
+
+void printInternStats(FILE *listing) {
+	int k, probes, most = 0;
+	long total = 0;
+	unsigned size, i;
+	checkEpoch();
+	/* a lookup of a name probes the slots from its
+	   home slot up to the one holding it */
+	for (k = 1; slots != NULL && k < nsyms; k++) {
+		probes = 1;
+		for (i = syms[k].hash & slotMask; slots[i] != (SymId) k; i = (i + 1) & slotMask) probes++;
+		total += probes;
+		if (probes > most) most = probes;
+	}
+	size = slots ? slotMask + 1 : 0;
+	fprintf(listing, "Names: %d in %u slots, load factor %.3f\n", nsyms - 1, size,
+		size ? (nsyms - 1) / (double) size : 0.0);
+	fprintf(listing, "Slots probed per name: %.3f on average, %d at most\n",
+		nsyms > 1 ? total / (double) (nsyms - 1) : 0.0, most);
+	if (frozen != NULL)
+		fprintf(listing, "Names frozen after the declarations: %u, in %u buckets\n", nfrozen, nbuckets);
+}
@@ -0,0 +1,59 @@
+/****************************************************/
+/* File: intern.h                                   */
+/* Identifier interning for the TINY compiler       */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _INTERN_H_
+#define _INTERN_H_
+
+/* Function nameHash returns the hash of the name
+ * s of length len that internName expects
+ */
+unsigned nameHash(const char *s, int len);
+
+/* Function internName returns the symbol id of the
+ * name s of length len, whose hash is nameHash(s,
+ * len), adding the name the first time it is seen.
+ * Ids are numbered from 1 in order of first sight;
+ * NOSYM is returned if out of memory.
+ */
+SymId internName(const char *s, int len, unsigned hash);
+
+/* Function arenaString copies the text s of length
+ * len, which need not be NUL-terminated, into the
+ * compilation arena that holds the interned names
+ * and returns the NUL-terminated copy (NULL if out of
+ * memory); AST nodes that must own the text of a
+ * lexeme take it from here
+ */
+char *arenaString(const char *s, int len);
+
+/* Function symName returns the interned text of id;
+ * it stays valid for the rest of the compilation
+ */
+char *symName(SymId id);
+
+/* Function symCount returns the number of ids
+ * handed out so far
+ */
+int symCount(void);
+
+/* Procedure freezeNames fixes the names interned so
+ * far, the declared ones, in a minimal perfect hash
+ * that internName tries first: one probe and one
+ * compare of the name. Names seen later still go
+ * into the open-addressing table.
+ */
+void freezeNames(void);
+
+/* Procedure printInternStats prints the number of
+ * names, the load factor of the table they are found
+ * through, and the number of slots looking each of
+ * them up probes, and the size of the
+ * frozen table if any, to the listing file
+ */
+void printInternStats(FILE *listing);
+
+#endif
@@ -18,12 +18,18 @@
 #define NO_CODE FALSE
 
 #include "util.h"
+#include "arena.h"
+#include "intern.h"
 #if NO_PARSE
 #include "scan.h"
 #else
+#include "scan.h"
+#include "tree.h"
 #include "parse.h"
 #if !NO_ANALYZE
+#include "symtab.h"
 #include "analyze.h"
+#include "astcache.h"
 #if !NO_CODE
 #include "cgen.h"
 #endif
@@ -31,7 +37,8 @@
 #endif
 
 /* allocate global variables */
-int lineno = 0;
+THREAD_LOCAL int lineno = 0;
+THREAD_LOCAL int tokenpos = 0;
 FILE *source;
 FILE *listing;
 FILE *code;
@@ -43,16 +50,57 @@ int TraceParse = TRUE;
 int TraceAnalyze = TRUE;
 int TraceCode = TRUE;
 
+int ScanWholeFile = FALSE;
+int LexThreads = 1;
+int ParseThreads = 1;
+int ShareExps = FALSE;
+int OnePass = FALSE;
+
 int Error = FALSE;
 
+static void usage(char *prog) {
+	fprintf(stderr, "usage: %s [--token-stream] [--lex-threads N] [--parse-threads N] [--share-exps] [--one-pass] [--ast-cache] [--symtab-stats] [--xref NAME[:FIRST-LAST]] <filename>\n", prog);
+	exit(1);
+}
+
 int main(int argc, char *argv[]) {
-	TreeNode *syntaxTree;
+	TreeNode *syntaxTree = NULL;
 	char pgm[120]; /* source code file name */
-	if (argc != 2) {
-		fprintf(stderr, "usage: %s <filename>\n", argv[0]);
-		exit(1);
-	}
-	strcpy(pgm, argv[1]);
+	int argi;
+	int useCache = FALSE, cached = FALSE, symtabStats = FALSE;
+	const char *text = NULL; /* source text, for the cache */
+	char *xrefName = NULL; /* the variable --xref lists */
+	int xrefFirst = 1, xrefLast = INT_MAX;
+	size_t textLen = 0;
+	for (argi = 1; argi < argc && argv[argi][0] == '-'; argi++)
+		if (strcmp(argv[argi], "--token-stream") == 0)
+			ScanWholeFile = TRUE;
+		else if (strcmp(argv[argi], "--lex-threads") == 0 && argi + 1 < argc) {
+			ScanWholeFile = TRUE;
+			LexThreads = atoi(argv[++argi]);
+		} else if (strcmp(argv[argi], "--parse-threads") == 0 && argi + 1 < argc) {
+			ScanWholeFile = TRUE;
+			ParseThreads = atoi(argv[++argi]);
+		} else if (strcmp(argv[argi], "--share-exps") == 0)
+			ShareExps = TRUE;
+		else if (strcmp(argv[argi], "--one-pass") == 0)
+			OnePass = TRUE;
+		else if (strcmp(argv[argi], "--ast-cache") == 0)
+			useCache = TRUE;
+		else if (strcmp(argv[argi], "--symtab-stats") == 0)
+			symtabStats = TRUE;
+		else if (strcmp(argv[argi], "--xref") == 0 && argi + 1 < argc) {
+			char *range;
+			xrefName = argv[++argi];
+			if ((range = strchr(xrefName, ':')) != NULL) {
+				*range++ = '\0';
+				if (sscanf(range, "%d-%d", &xrefFirst, &xrefLast) != 2) usage(argv[0]);
+			}
+		}
+		else
+			usage(argv[0]);
+	if (argi != argc - 1) usage(argv[0]);
+	strcpy(pgm, argv[argi]);
 	if (strchr(pgm, '.') == NULL)
 		strcat(pgm, ".tny");
 
@@ -61,30 +109,67 @@ int main(int argc, char *argv[]) {
 		fprintf(stderr, "File %s not found\n", pgm);
 		exit(1);
 	}
+	/* the whole-file scan and the AST cache need the
+	   source held whole, which the flex scanner does not */
+	if ((ScanWholeFile || useCache) && sourceText(&textLen) == NULL) {
+		fprintf(stderr, "%s: this scanner does not support --token-stream, --lex-threads, --parse-threads or --ast-cache\n", argv[0]);
+		exit(1);
+	}
 	listing = stdout; /* send listing to screen */
 	fprintf(listing, "\nTINY COMPILATION: %s\n", pgm);
 #if NO_PARSE
-	while (getToken() != ENDFILE)
-		;
+	if (ScanWholeFile)
+		freeTokenStream(scanAll());
+	else
+		while (getToken() != ENDFILE)
+			;
 #else
-	syntaxTree = parse();
-	if (TraceParse) {
+	if (OnePass) {
+		/* the code comes out as the parser goes */
+		code = listing;
+		fprintf(code, "\nOutput Intermediate Code:\n");
+	}
+#if !NO_ANALYZE
+	if (useCache && !OnePass && (text = sourceText(&textLen)) != NULL &&
+		(syntaxTree = loadAstCache(pgm, text, textLen)) != NULL) {
+		/* scanning, parsing and checking are skipped */
+		cached = TRUE;
+		fprintf(listing, "\nChecked syntax tree loaded from %s.ast\n", pgm);
+	}
+#endif
+	if (!cached) syntaxTree = parse();
+	if (TraceParse && !OnePass) {
 		fprintf(listing, "\nSyntax tree:\n");
 		printTree(syntaxTree);
 	}
 #if !NO_ANALYZE
-	if (!Error) {
-		if (TraceAnalyze) fprintf(listing, "\nChecking Symbol Table...\n");
-		buildSymtab(syntaxTree);
-		if (TraceAnalyze) fprintf(listing, "\nSymbol Table Checking Finished\n");
+	if ((OnePass || cached) && TraceAnalyze) {
+		fprintf(listing, "\nSymbol table:\n\n");
+		printSymTab(listing);
+	}
+	if (!Error && !OnePass && !cached) {
+		if (TraceAnalyze) fprintf(listing, "\nChecking Symbol Table and Types...\n");
+		analyze(syntaxTree);
+		if (TraceAnalyze) {
+			fprintf(listing, "\nSymbol table:\n\n");
+			printSymTab(listing);
+			fprintf(listing, "\nChecking Finished\n");
+		}
+		if (!Error && text != NULL) saveAstCache(pgm, text, textLen, syntaxTree);
 	}
-	if (!Error) {
-		if (TraceAnalyze) fprintf(listing, "\nChecking Types...\n");
-		typeCheck(syntaxTree);
-		if (TraceAnalyze) fprintf(listing, "\nType Checking Finished\n");
+	if (symtabStats) {
+		fprintf(listing, "\nSymbol table statistics:\n");
+		printInternStats(listing);
+	}
+	if (xrefName != NULL && !Error) {
+		fprintf(listing, "\n");
+		printXref(listing, internName(xrefName, strlen(xrefName), nameHash(xrefName, strlen(xrefName))),
+			xrefFirst, xrefLast);
 	}
 #if !NO_CODE
-	if (!Error) {
+	if (!Error && OnePass)
+		codeGenFinish();
+	else if (!Error) {
 		code = listing;
 		fprintf(code, "\nOutput Intermediate Code:\n");
 		codeGen(syntaxTree);
@@ -93,5 +178,10 @@ int main(int argc, char *argv[]) {
 #endif
 #endif
 	fclose(source);
+#if !NO_PARSE && !NO_ANALYZE
+	if (cached) closeAstCache();
+#endif
+	/* the tree, lexeme copies and names go at once */
+	arenaReset();
 	return 0;
 }
@@ -0,0 +1,85 @@
+/****************************************************/
+/* File: mkkeys.c                                   */
+/* Build-time generator of the reserved word hash   */
+/* table (keyhash.h) used by the TINY scanner       */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+
+/* the reserved words, taken from globals.h */
+#define RESERVED_ENTRY(tok, str) { str, #tok },
+static struct
+{
+	char *str;
+	char *tok;
+} words[MAXRESERVED] = { RESERVED_WORDS(RESERVED_ENTRY) };
+
+/* MAXMULT = bound on the multipliers tried for
+   the first, second and last character */
+#define MAXMULT 32
+
+/* MAXTABLE = largest table size tried */
+#define MAXTABLE 4096
+
+/* keyHash must agree with the KEYHASH macro
+   written to keyhash.h; a one-character word uses
+   its only character as the second one */
+static unsigned keyHash(char *s, unsigned a, unsigned b, unsigned c, unsigned mask) {
+	unsigned n = strlen(s);
+	return ((unsigned char) s[0] * a + (unsigned char) s[n > 1] * b +
+			   (unsigned char) s[n - 1] * c + n) &
+		   mask;
+}
+
+/* tryHash returns TRUE if (a, b, c) maps every
+   reserved word to a distinct slot of slot[] */
+static int tryHash(unsigned a, unsigned b, unsigned c, unsigned size, int *slot) {
+	unsigned i;
+	for (i = 0; i < size; i++) slot[i] = -1;
+	for (i = 0; i < MAXRESERVED; i++) {
+		unsigned h = keyHash(words[i].str, a, b, c, size - 1);
+		if (slot[h] != -1) return FALSE;
+		slot[h] = i;
+	}
+	return TRUE;
+}
+
+static void emitTable(unsigned a, unsigned b, unsigned c, unsigned size, int *slot) {
+	unsigned i;
+	printf("/* keyhash.h -- generated by mkkeys from the RESERVED_WORDS\n");
+	printf("   list in globals.h; do not edit */\n\n");
+	printf("#define KEYTABLE_SIZE %u\n\n", size);
+	printf("/* KEYHASH maps the lexeme s of length len to its slot */\n");
+	printf("#define KEYHASH(s, len) \\\n");
+	printf("\t(((unsigned char) (s)[0] * %uu + (unsigned char) (s)[(len) > 1] * %uu + \\\n", a, b);
+	printf("\t\t (unsigned char) (s)[(len) - 1] * %uu + (unsigned) (len)) & %uu)\n\n", c, size - 1);
+	printf("static const struct\n{\n\tchar *str;\n\tint len;\n\tTokenType tok;\n}");
+	printf(" keyTable[KEYTABLE_SIZE] = {\n");
+	for (i = 0; i < size; i++)
+		if (slot[i] == -1)
+			printf("\t{ \"\", 0, ID },\n");
+		else
+			printf("\t{ \"%s\", %u, %s },\n", words[slot[i]].str,
+				(unsigned) strlen(words[slot[i]].str), words[slot[i]].tok);
+	printf("};\n");
+}
+
+int main(void) {
+	static int slot[MAXTABLE];
+	unsigned size, a, b, c;
+	for (size = 1; size < MAXRESERVED; size <<= 1)
+		;
+	for (; size <= MAXTABLE; size <<= 1)
+		for (a = 1; a < MAXMULT; a++)
+			for (b = 0; b < MAXMULT; b++)
+				for (c = 0; c < MAXMULT; c++)
+					if (tryHash(a, b, c, size, slot)) {
+						emitTable(a, b, c, size, slot);
+						return 0;
+					}
+	fprintf(stderr, "mkkeys: no perfect hash on (length, first, second, last) "
+					"for the reserved words in globals.h\n");
+	return 1;
+}
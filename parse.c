@@ -8,41 +8,159 @@
 #include "globals.h"
 #include "util.h"
 #include "scan.h"
+#include "tree.h"
 #include "parse.h"
 #include "symtab.h"
+#include "intern.h"
+#include "analyze.h"
+#include "code.h"
+#include "cgen.h"
 
-static TokenType token; /* holds current token */
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/* The parser state is kept per thread, so that
+   threads can parse ranges of the program at once
+   (see parseParallel) */
+
+static THREAD_LOCAL TokenType token; /* holds current token */
+
+/* cursor over the whole-file token stream,
+   used when ScanWholeFile is set; the token at
+   cursorEnd reads as ENDFILE */
+static THREAD_LOCAL TokenCursor cursor;
+static THREAD_LOCAL int cursorEnd;
+
+/* quiet = TRUE makes syntax errors only set
+   rangeFailed, for a range parsed on a thread */
+static THREAD_LOCAL int quiet = FALSE;
+static THREAD_LOCAL int rangeFailed = FALSE;
+
+/* syntaxFailed is set by the first syntax error
+   reported; one-pass mode checks no statement after
+   it, as its operands may be missing */
+static THREAD_LOCAL int syntaxFailed = FALSE;
+
+/* startCursor puts the cursor on token pos of ts,
+   and the parser on the token there */
+static void startCursor(const TokenStream *ts, int pos, int end) {
+	cursor.ts = ts;
+	cursor.pos = pos;
+	cursorEnd = end;
+	lineno = cursorLine(&cursor);
+	tokenpos = cursorOffset(&cursor);
+	token = (pos == end) ? ENDFILE : cursorToken(&cursor);
+}
+
+/* nextToken fetches the next token, either
+   straight from the scanner or from the stream */
+static TokenType nextToken(void) {
+	if (!ScanWholeFile) return getToken();
+	if (cursor.pos < cursorEnd) cursorAdvance(&cursor);
+	lineno = cursorLine(&cursor);
+	tokenpos = cursorOffset(&cursor);
+	return (cursor.pos == cursorEnd) ? ENDFILE : cursorToken(&cursor);
+}
+
+/* lexeme returns the text of the current token as
+   a view into the source and stores its length in
+   *len; the text is not NUL-terminated */
+static const char *lexeme(int *len) {
+	if (!ScanWholeFile) {
+		*len = tokenLength;
+		return tokenString;
+	}
+	*len = cursorLength(&cursor);
+	return cursorText(&cursor);
+}
+
+/* lexemeSym returns the interned id of the current
+   token; the scanner has interned every ID already */
+static SymId lexemeSym(void) {
+	const char *s;
+	int len;
+	if (token == ID) return ScanWholeFile ? cursorSym(&cursor) : tokenSym;
+	/* a declaration missing its name still enters
+	   whatever token stands in its place */
+	s = lexeme(&len);
+	return internName(s, len, nameHash(s, len));
+}
+
+/* textNode gives the StrK node t the text of the
+   current lexeme */
+static void textNode(ParseNode *t) {
+	int len;
+	const char *s = lexeme(&len);
+	setNodeText(t, s, len);
+}
+
+/* lexemeValue converts the digits of the current
+   token to a number the way atoi would */
+static int lexemeValue(void) {
+	int len, i;
+	const char *s = lexeme(&len);
+	long v = 0;
+	for (i = 0; i < len; i++) {
+		if (v > (LONG_MAX - (s[i] - '0')) / 10) return (int) LONG_MAX;
+		v = 10 * v + (s[i] - '0');
+	}
+	return (int) v;
+}
+
+/* nameNode sets the name of t to the current ID */
+static void nameNode(ParseNode *t) {
+	t->attr.sym = lexemeSym();
+}
+
+/* binding strengths of the binary operators, from
+   the loosest; 0 for any other token */
+#define OR_PREC 1
+#define AND_PREC 2
+#define REL_PREC 3
+#define ADD_PREC 4
+#define MUL_PREC 5
+
+static const unsigned char precedence[COMMA + 1] = {
+	[OR] = OR_PREC,
+	[AND] = AND_PREC,
+	[EQ] = REL_PREC,
+	[LT] = REL_PREC,
+	[LE] = REL_PREC,
+	[GT] = REL_PREC,
+	[GE] = REL_PREC,
+	[PLUS] = ADD_PREC,
+	[MINUS] = ADD_PREC,
+	[TIMES] = MUL_PREC,
+	[OVER] = MUL_PREC};
 
 /* counter for variable memory locations */
 static int location = 0;
 
 /* function prototypes for recursive calls */
 static void declarations(void);
-static TreeNode *stmt_sequence(void);
-static TreeNode *statement(void);
-static TreeNode *if_stmt(void);
-static TreeNode *repeat_stmt(void);
-static TreeNode *assign_stmt(void);
-static TreeNode *read_stmt(void);
-static TreeNode *write_stmt(void);
-static TreeNode *expr(void);
-static TreeNode *simple_exp(void);
-static TreeNode *term(void);
-static TreeNode *factor(void);
-static TreeNode *bool_exp(void);
-static TreeNode *bterm(void);
-static TreeNode *bfactor(void);
-static TreeNode *while_stmt(void);
+static void program(void);
+static ParseNode *assign_stmt(void);
+static ParseNode *read_stmt(void);
+static ParseNode *write_stmt(void);
+static ParseNode *expr(void);
+static ParseNode *prec_exp(int prec);
 
 static void syntaxError(char *message) {
+	if (quiet) {
+		rangeFailed = TRUE;
+		return;
+	}
 	fprintf(listing, ">>> ");
-	fprintf(listing, "Syntax error at line %d: %s", lineno, message);
+	fprintf(listing, "Syntax error at line %d, column %d: %s", lineno, sourceColumn(tokenpos), message);
 	Error = TRUE;
+	syntaxFailed = TRUE;
 }
 
 static void match(TokenType expected) {
 	if (token == expected)
-		token = getToken();
+		token = nextToken();
 	else {
 		if (expected == SEMI)
 			syntaxError("missing \';\'\n");
@@ -55,7 +173,7 @@ static void match(TokenType expected) {
 		else if (expected == ASSIGN) {
 			if (token == EQ) {
 				syntaxError("should be \':=\' instead of \'=\'\n");
-				token = getToken();
+				token = nextToken();
 			} else
 				syntaxError("missing \':=\'\n");
 		} else if (expected == DO)
@@ -67,250 +185,354 @@ static void match(TokenType expected) {
 	}
 }
 
-TreeNode *stmt_sequence(void) {
-	TreeNode *t = statement();
-	TreeNode *p = t;
-	while ((token != ENDFILE) && (token != END) &&
-		   (token != ELSE) && (token != UNTIL)) {
-		TreeNode *q;
-		match(SEMI);
-		q = statement();
-		if (q != NULL) {
-			if (t == NULL)
-				t = p = q;
-			else /* now p cannot be NULL either */
-			{
-				p->sibling = q;
-				p = q;
-			}
+/* OpenStmt is an if, repeat or while statement
+   whose statement sequence for child slot is being
+   parsed; head and tail hold it so far. In one-pass
+   mode node is NULL and rec is its record, whose
+   code is under way */
+typedef struct {
+	ParseNode *node;
+	StmtKind kind;
+	int slot;
+	ParseNode *head, *tail;
+	TreeNode rec;
+} OpenStmt;
+
+/* the stack of open statements, innermost last */
+static THREAD_LOCAL OpenStmt *openStmt = NULL;
+static THREAD_LOCAL int nopen = 0, openSize = 0;
+
+/* openStatement pushes t, of the given kind, whose
+   sequence for child slot comes next */
+static int openStatement(ParseNode *t, StmtKind kind, int slot) {
+	if (nopen == openSize) {
+		int n = openSize ? 2 * openSize : 64;
+		OpenStmt *p = (OpenStmt *) realloc(openStmt, n * sizeof(OpenStmt));
+		if (p == NULL) {
+			fprintf(listing, "Out of memory error at line %d\n", lineno);
+			Error = TRUE;
+			return FALSE;
 		}
+		openStmt = p;
+		openSize = n;
 	}
-	return t;
+	openStmt[nopen].node = t;
+	openStmt[nopen].kind = kind;
+	openStmt[nopen].slot = slot;
+	openStmt[nopen].head = openStmt[nopen].tail = NULL;
+	memset(&openStmt[nopen].rec, 0, sizeof(TreeNode));
+	nopen++;
+	return TRUE;
 }
 
-TreeNode *statement(void) {
-	TreeNode *t = NULL;
-	switch (token) {
-		case IF:
-			t = if_stmt();
-			break;
-		case REPEAT:
-			t = repeat_stmt();
-			break;
-		case ID:
-			t = assign_stmt();
-			break;
-		case READ:
-			t = read_stmt();
-			break;
-		case WRITE:
-			t = write_stmt();
-			break;
-		case WHILE:
-			t = while_stmt();
-			break;
-		case ENDFILE:
-			syntaxError("unexpected file end");
-			break;
-		default:
-			syntaxError("unexpected token\n");
-			token = getToken();
-			break;
-	} /* end case */
-	return t;
+/* In one-pass mode (OnePass) the parser builds no
+ * tree: as soon as it has seen a leaf statement, or
+ * the head of an if, repeat or while, it lays that
+ * out on its own, checks it and generates its code,
+ * and then reuses its parse nodes. The actions of
+ * codeGenVisitor are applied in the order a walk of
+ * the whole tree would apply them, so forward jumps
+ * are backpatched as codeGen does.
+ */
+
+/* passNode lays out and checks the statement t
+   and returns its records, or NULL; an operand that
+   expr left out is an error here. Names are recorded
+   and types checked after an undeclared name or a
+   type error too, as the multi-pass path records
+   them all; any error stops only the code. */
+static TreeNode *passNode(ParseNode *t) {
+	TreeNode *r;
+	int need;
+	if (t == NULL) return NULL;
+	need = (t->kind.stmt == ReadK) ? 0 : (t->kind.stmt == RepeatK) ? CHILD(1) : CHILD(0);
+	r = layoutNode(t);
+	if (r != NULL && !syntaxFailed && (r->flags & need) != need)
+		syntaxError("missing expression\n");
+	if (r != NULL && !syntaxFailed) walkTree(r, &analyzeVisitor);
+	return r;
 }
 
-TreeNode *if_stmt(void) {
-	TreeNode *t = newStmtNode(IfK);
-	match(IF);
-	if (t != NULL) t->child[0] = bool_exp();
-	match(THEN);
-	if (t != NULL) t->child[1] = stmt_sequence();
-	if (token == ELSE) {
-		match(ELSE);
-		if (t != NULL) t->child[2] = stmt_sequence();
+/* passOpen generates the code of the open statement
+   o up to its sequence for slot: r is its record,
+   followed by those of its test if any */
+static void passOpen(OpenStmt *o, TreeNode *r) {
+	int k;
+	codeGenVisitor.pre(r);
+	for (k = 0; k < o->slot; k++) {
+		if (r->flags & CHILD(k)) walkTree(nodeChild(r, k), &codeGenVisitor);
+		codeGenVisitor.in(r, k);
 	}
-	match(END);
-	return t;
+	o->rec = *r;
+	o->rec.flags &= ~(CHILD(0) | CHILD(1) | CHILD(2));
 }
 
-TreeNode *repeat_stmt(void) {
-	TreeNode *t = newStmtNode(RepeatK);
-	match(REPEAT);
-	if (t != NULL) t->child[0] = stmt_sequence();
-	match(UNTIL);
-	if (t != NULL) t->child[1] = bool_exp();
-	return t;
+/* passClose generates the code of the statement
+   with record r after its child slots up to slot */
+static void passClose(TreeNode *r, int slot) {
+	for (; slot < MAXCHILDREN; slot++) codeGenVisitor.in(r, slot);
+	codeGenVisitor.post(r);
+	emitFlush();
+}
+
+/* program parses the statements of the program by
+ * the grammar
+ *   stmt_sequence -> statement { ; statement }
+ *   statement -> if_stmt | repeat_stmt | assign_stmt
+ *              | read_stmt | write_stmt | while_stmt
+ *   if_stmt -> if exp then stmt_sequence
+ *              [ else stmt_sequence ] end
+ *   repeat_stmt -> repeat stmt_sequence until exp
+ *   while_stmt -> while exp do stmt_sequence end
+ * keeping the statements still open on a stack of
+ * its own, so that nesting takes heap rather than C
+ * stack. Each top-level statement is handed to the
+ * tree as soon as it is whole.
+ */
+static void program(void) {
+	nopen = 0;
+	for (;;) {
+		/* a statement starts here */
+		ParseNode *t = NULL, *e;
+		switch (token) {
+			case IF:
+				t = newStmtNode(IfK);
+				match(IF);
+				e = prec_exp(OR_PREC);
+				if (t != NULL) t->child[0] = e;
+				match(THEN);
+				if (OnePass) {
+					TreeNode *r = passNode(t);
+					if (!openStatement(NULL, IfK, 1)) return;
+					if (r != NULL) passOpen(&openStmt[nopen - 1], r);
+				} else if (!openStatement(t, IfK, 1))
+					return;
+				continue;
+			case REPEAT:
+				t = newStmtNode(RepeatK);
+				match(REPEAT);
+				if (OnePass) {
+					/* checked once its test is seen */
+					TreeNode *r = (t != NULL) ? layoutNode(t) : NULL;
+					if (!openStatement(NULL, RepeatK, 0)) return;
+					if (r != NULL) passOpen(&openStmt[nopen - 1], r);
+				} else if (!openStatement(t, RepeatK, 0))
+					return;
+				continue;
+			case WHILE:
+				t = newStmtNode(WhileK);
+				match(WHILE);
+				e = prec_exp(OR_PREC);
+				if (t != NULL) t->child[0] = e;
+				match(DO);
+				if (OnePass) {
+					TreeNode *r = passNode(t);
+					if (!openStatement(NULL, WhileK, 1)) return;
+					if (r != NULL) passOpen(&openStmt[nopen - 1], r);
+				} else if (!openStatement(t, WhileK, 1))
+					return;
+				continue;
+			case ID:
+				t = assign_stmt();
+				break;
+			case READ:
+				t = read_stmt();
+				break;
+			case WRITE:
+				t = write_stmt();
+				break;
+			case ENDFILE:
+				syntaxError("unexpected file end");
+				break;
+			default:
+				syntaxError("unexpected token\n");
+				token = nextToken();
+				break;
+		} /* end case */
+		if (OnePass && t != NULL) {
+			TreeNode *r = passNode(t);
+			if (r != NULL) {
+				walkTree(r, &codeGenVisitor);
+				emitFlush();
+			}
+			t = NULL;
+		}
+		/* t is whole: add it to its sequence, then close
+		   the statements whose sequence ends here */
+		for (;;) {
+			OpenStmt *o = nopen ? &openStmt[nopen - 1] : NULL;
+			if (t != NULL) {
+				if (o == NULL)
+					appendStatement(t);
+				else {
+					if (o->tail == NULL)
+						o->head = t;
+					else
+						o->tail->sibling = t;
+					o->tail = t;
+				}
+			}
+			if ((token != ENDFILE) && (token != END) &&
+				(token != ELSE) && (token != UNTIL)) {
+				match(SEMI);
+				break;
+			}
+			if (o == NULL) return;
+			t = o->node;
+			if (t != NULL) t->child[o->slot] = o->head;
+			if (o->kind == IfK && o->slot == 1 && token == ELSE) {
+				match(ELSE);
+				if (OnePass) {
+					o->rec.flags |= CHILD(2);
+					codeGenVisitor.in(&o->rec, 1);
+				}
+				o->slot = 2;
+				o->head = o->tail = NULL;
+				break;
+			}
+			nopen--;
+			if (o->kind == RepeatK) {
+				match(UNTIL);
+				e = prec_exp(OR_PREC);
+				if (t != NULL) t->child[1] = e;
+				if (OnePass) {
+					/* the test comes with a record of its own */
+					TreeNode *r;
+					codeGenVisitor.in(&o->rec, 0);
+					if ((t = newStmtNode(RepeatK)) != NULL) t->child[1] = e;
+					if ((r = passNode(t)) != NULL) {
+						if (r->flags & CHILD(1)) walkTree(nodeChild(r, 1), &codeGenVisitor);
+						passClose(r, 1);
+					}
+					t = NULL;
+				}
+			} else {
+				match(END);
+				if (OnePass) passClose(&o->rec, o->slot);
+			}
+		}
+	}
 }
 
-TreeNode *assign_stmt(void) {
-	TreeNode *t = newStmtNode(AssignK);
+ParseNode *assign_stmt(void) {
+	ParseNode *t = newStmtNode(AssignK);
 	if ((t != NULL) && (token == ID))
-		t->attr.name = copyString(tokenString);
+		nameNode(t);
 	match(ID);
 	match(ASSIGN);
 	if (t != NULL) t->child[0] = expr();
 	return t;
 }
 
-TreeNode *read_stmt(void) {
-	TreeNode *t = newStmtNode(ReadK);
+ParseNode *read_stmt(void) {
+	ParseNode *t = newStmtNode(ReadK);
 	match(READ);
 	if ((t != NULL) && (token == ID))
-		t->attr.name = copyString(tokenString);
+		nameNode(t);
 	match(ID);
 	return t;
 }
 
-TreeNode *write_stmt(void) {
-	TreeNode *t = newStmtNode(WriteK);
+ParseNode *write_stmt(void) {
+	ParseNode *t = newStmtNode(WriteK);
 	match(WRITE);
 	if (t != NULL) t->child[0] = expr();
 	return t;
 }
 
-TreeNode *expr(void) {
-	TreeNode *t = NULL;
+ParseNode *expr(void) {
+	ParseNode *t = NULL;
 	if (token == STR) {
 		t = newExpNode(StrK);
 		if (t != NULL)
-			t->attr.name = copyString(tokenString);
+			textNode(t);
 		match(STR);
 	} else if (token == NUM || token == ID || token == BTRUE || token == BFALSE || token == NOT || token == LPAREN)
-		t = bool_exp();
-	return t;
-}
-
-TreeNode *simple_exp(void) {
-	TreeNode *t = term();
-	while ((token == PLUS) || (token == MINUS)) {
-		TreeNode *p = newExpNode(OpK);
-		if (p != NULL) {
-			p->child[0] = t;
-			p->attr.op = token;
-			t = p;
-			match(token);
-			t->child[1] = term();
-		}
-	}
-	return t;
-}
-
-TreeNode *term(void) {
-	TreeNode *t = factor();
-	while ((token == TIMES) || (token == OVER)) {
-		TreeNode *p = newExpNode(OpK);
-		if (p != NULL) {
-			p->child[0] = t;
-			p->attr.op = token;
-			t = p;
-			match(token);
-			p->child[1] = factor();
-		}
-	}
+		t = prec_exp(OR_PREC);
+	else
+		syntaxError("missing expression\n");
 	return t;
 }
 
-TreeNode *factor(void) {
-	TreeNode *t = NULL;
-	switch (token) {
+/* prec_exp parses an expression made of operators
+ * that bind at least as tightly as prec, climbing
+ * the precedence table. It builds the trees of the
+ * grammar
+ *   bool_exp -> bterm { or bterm }
+ *   bterm -> bfactor { and bfactor }
+ *   bfactor -> true | false | not bfactor
+ *            | simple_exp [ relop simple_exp ]
+ *   simple_exp -> term { addop term }
+ *   term -> factor { mulop factor }
+ *   factor -> number | id | ( bool_exp )
+ * so relational operators do not chain, and the
+ * operand of not, true and false, and a comparison
+ * can only be followed by and or or. limit is the
+ * tightest operator the expression built so far may
+ * be the left operand of.
+ */
+static ParseNode *prec_exp(int prec) {
+	ParseNode *t = NULL;
+	int limit = MUL_PREC;
+	TokenType first = token;
+	if (prec > REL_PREC && (token == BTRUE || token == BFALSE || token == NOT))
+		first = ERROR; /* only a factor may stand here */
+	switch (first) {
 		case NUM:
 			t = newExpNode(ConstK);
-			if ((t != NULL) && (token == NUM))
-				t->attr.val = atoi(tokenString);
-			match(NUM);
+			if (t != NULL)
+				t->attr.val = lexemeValue();
+			token = nextToken();
 			break;
 		case ID:
 			t = newExpNode(IdK);
-			if ((t != NULL) && (token == ID))
-				t->attr.name = copyString(tokenString);
-			match(ID);
+			if (t != NULL)
+				nameNode(t);
+			token = nextToken();
 			break;
 		case LPAREN:
-			match(LPAREN);
-			t = bool_exp();
+			token = nextToken();
+			t = prec_exp(OR_PREC);
 			match(RPAREN);
 			break;
-		default:
-			syntaxError("unexpected token\n");
-			token = getToken();
-			break;
-	}
-	return t;
-}
-
-TreeNode *bool_exp(void) {
-	TreeNode *t = bterm();
-	while (token == OR) {
-		TreeNode *p = newExpNode(OpK);
-		if (p != NULL) {
-			p->child[0] = t;
-			p->attr.op = token;
-			t = p;
-			match(token);
-			t->child[1] = bterm();
-		}
-	}
-	return t;
-}
-
-TreeNode *bterm(void) {
-	TreeNode *t = bfactor();
-	while (token == AND) {
-		TreeNode *p = newExpNode(OpK);
-		if (p != NULL) {
-			p->child[0] = t;
-			p->attr.op = token;
-			t = p;
-			match(token);
-			p->child[1] = bfactor();
-		}
-	}
-	return t;
-}
-
-TreeNode *bfactor(void) {
-	TreeNode *t = NULL;
-	switch (token) {
 		case BTRUE:
 		case BFALSE:
 			t = newExpNode(BoolK);
-			if ((t != NULL) && (token == BTRUE)) {
-				t->attr.val = 1;  //true
-				match(BTRUE);
-			} else {
-				t->attr.val = 0;  //false
-				match(BFALSE);
-			}
+			if (t != NULL)
+				t->attr.val = (token == BTRUE);
+			token = nextToken();
+			limit = AND_PREC;
 			break;
 		case NOT:
 			t = newExpNode(OpK);
-			t->attr.op = token;
-			match(NOT);
-			if (t != NULL)
-				t->child[0] = bfactor();
-			break;
-		case NUM:
-		case ID:
-		case LPAREN:
-			t = simple_exp();
-			if ((token == LT) || (token == EQ) || (token == LE) || (token == GT) || (token == GE)) {
-				TreeNode *p = newExpNode(OpK);
-				if (p != NULL) {
-					p->child[0] = t;
-					p->attr.op = token;
-					t = p;
-				}
-				match(token);
-				if (t != NULL)
-					t->child[1] = simple_exp();
-			}
+			token = nextToken();
+			if (t != NULL) {
+				t->attr.op = NOT;
+				t->child[0] = prec_exp(REL_PREC);
+			} else
+				prec_exp(REL_PREC);
+			limit = AND_PREC;
 			break;
 		default:
+			if (prec <= REL_PREC) limit = AND_PREC;
 			syntaxError("unexpected token\n");
-			token = getToken();
+			token = nextToken();
 			break;
 	}
+	while (precedence[token] >= prec && precedence[token] <= limit) {
+		int p = precedence[token];
+		TokenType op = token;
+		ParseNode *q = newExpNode(OpK), *r;
+		token = nextToken();
+		r = prec_exp(p + 1);
+		if (q != NULL) {
+			q->attr.op = op;
+			q->child[0] = t;
+			q->child[1] = r;
+			t = q;
+		}
+		limit = (p == REL_PREC) ? AND_PREC : p;
+	}
 	return t;
 }
 
@@ -334,26 +556,180 @@ void declarations(void) {
 		//type-specifier
 		match(token);
 		//varlist
-		st_insert(tokenString, type, lineno, location++);
+		st_insert(lexemeSym(), type, tokenpos, location++);
 		match(ID);
 		while (token == COMMA) {
 			match(COMMA);
-			st_insert(tokenString, type, lineno, location++);
+			st_insert(lexemeSym(), type, tokenpos, location++);
 			match(ID);
 		}
 		match(SEMI);  //';' is expected
 	}
 }
 
-TreeNode *while_stmt(void) {
-	TreeNode *t = newStmtNode(WhileK);
-	match(WHILE);
-	if (t != NULL)
-		t->child[0] = bool_exp();
-	match(DO);
-	if (t != NULL) t->child[1] = stmt_sequence();
-	match(END);
-	return t;
+/* MINRANGE = fewest tokens worth parsing on a
+   thread of their own */
+#ifndef MINRANGE
+#define MINRANGE 65536
+#endif
+
+/* MAXRANGES = bound on the number of ranges */
+#define MAXRANGES 256
+
+/* Range is a run of top-level statements: tokens
+   [begin, end) of the stream, where end is a
+   top-level ';' or the final ENDFILE */
+typedef struct {
+	const TokenStream *ts;
+	int begin, end;
+	int failed;
+	StatementRun run;
+} Range;
+
+/* parseRange parses the statements of one range
+   on the thread it runs on, reporting no errors */
+static void *parseRange(void *arg) {
+	Range *r = (Range *) arg;
+	quiet = TRUE;
+	rangeFailed = FALSE;
+	startCursor(r->ts, r->begin, r->end);
+	program();
+	r->failed = rangeFailed || token != ENDFILE;
+	takeStatements(&r->run);
+	free(openStmt);
+	openStmt = NULL;
+	openSize = 0;
+	quiet = FALSE;
+	return NULL;
+}
+
+/* splitRanges cuts the statements from token begin
+   on into at most n ranges of about equal length,
+   at ';' outside any if, while or repeat, and
+   returns their number */
+static int splitRanges(const TokenStream *ts, int begin, int n, Range *range) {
+	int last = ts->count - 1, step = (last - begin) / n;
+	int i, depth = 0, k = 0;
+	range[0].begin = begin;
+	for (i = begin; i < last && k < n - 1; i++)
+		switch (ts->kind[i]) {
+			case IF:
+			case WHILE:
+			case REPEAT:
+				depth++;
+				break;
+			case END:
+			case UNTIL:
+				depth--;
+				break;
+			case SEMI:
+				if (depth == 0 && i >= begin + step * (k + 1)) {
+					range[k].end = i;
+					range[++k].begin = i + 1;
+				}
+				break;
+			default:
+				break;
+		}
+	range[k].end = last;
+	for (i = 0; i <= k; i++) {
+		range[i].ts = ts;
+		range[i].failed = FALSE;
+	}
+	return k + 1;
+}
+
+/* Function parseParallel parses the statements
+ * from the current token on in ranges, on up to
+ * ParseThreads threads, each laying out its
+ * statements in memory of its own; they are then
+ * joined in order. A range parsed cleanly ends at
+ * the top level, so the result is the tree parsing
+ * the whole sequence gives. Should any range fail,
+ * everything is dropped and FALSE returned, for the
+ * sequential parser to report the errors as usual.
+ */
+static int parseParallel(const TokenStream *ts) {
+#ifdef HAVE_PTHREAD
+	Range range[MAXRANGES];
+	pthread_t thread[MAXRANGES];
+	int started[MAXRANGES];
+	int begin = cursor.pos, n = ParseThreads, k, failed = FALSE;
+	if (n > MAXRANGES) n = MAXRANGES;
+	if (n > (ts->count - begin) / MINRANGE) n = (ts->count - begin) / MINRANGE;
+	if (n < 2 || token == ENDFILE) return FALSE;
+	n = splitRanges(ts, begin, n, range);
+	if (n < 2) return FALSE;
+	for (k = 1; k < n; k++)
+		started[k] = pthread_create(&thread[k], NULL, parseRange, &range[k]) == 0;
+	parseRange(&range[0]);
+	for (k = 1; k < n; k++)
+		if (started[k])
+			pthread_join(thread[k], NULL);
+		else
+			parseRange(&range[k]);
+	for (k = 0; k < n; k++) failed |= range[k].failed;
+	for (k = 0; k < n; k++)
+		if (failed)
+			free(range[k].run.rec);
+		else
+			appendRun(&range[k].run);
+	startCursor(ts, failed ? begin : ts->count - 1, ts->count - 1);
+	return !failed;
+#else
+	return FALSE;
+#endif
+}
+
+/* Function parseStatements parses the tokens
+ * [begin, end) of ts as a statement sequence, as a
+ * range is parsed, and leaves its records in run;
+ * FALSE, with run empty, if they are not one
+ */
+int parseStatements(const TokenStream *ts, int begin, int end, StatementRun *run) {
+	Range r;
+	r.ts = ts;
+	r.begin = begin;
+	r.end = end;
+	r.failed = FALSE;
+	parseRange(&r);
+	if (r.failed) {
+		free(r.run.rec);
+		r.run.rec = NULL;
+		r.run.count = r.run.last = 0;
+	}
+	*run = r.run;
+	return !r.failed;
+}
+
+/* parseProgram parses the declarations and the
+   statements from the current token on */
+static void parseProgram(const TokenStream *ts) {
+	location = 0;
+	syntaxFailed = FALSE;
+	if (token == INT || token == BOOL || token == STRING) {
+		declarations();
+	}
+	/* the names of the statements are looked up as
+	   they are scanned; all that are declared are
+	   known by now */
+	if (!ScanWholeFile) freezeNames();
+	if (ParseThreads < 2 || !ScanWholeFile || OnePass || !parseParallel(ts))
+		program();
+	if (token != ENDFILE)
+		syntaxError("Code ends before file\n");
+	free(openStmt);
+	openStmt = NULL;
+	openSize = 0;
+}
+
+/* Function parseTokens parses the whole program in
+ * ts as parse does, but leaves the records in run
+ */
+void parseTokens(const TokenStream *ts, StatementRun *run) {
+	startCursor(ts, 0, ts->count - 1);
+	parseProgram(ts);
+	takeStatements(run);
 }
 
 /****************************************/
@@ -363,13 +739,16 @@ TreeNode *while_stmt(void) {
  * constructed syntax tree
  */
 TreeNode *parse(void) {
-	TreeNode *t;
-	token = getToken();
-	if (token == INT || token == BOOL || token == STRING) {
-		declarations();
+	TokenStream *ts = NULL;
+	if (ScanWholeFile && (ts = scanAll()) == NULL) {
+		Error = TRUE;
+		return NULL;
 	}
-	t = stmt_sequence();
-	if (token != ENDFILE)
-		syntaxError("Code ends before file\n");
-	return t;
+	if (ScanWholeFile)
+		startCursor(ts, 0, ts->count - 1);
+	else
+		token = getToken();
+	parseProgram(ts);
+	freeTokenStream(ts);
+	return finishTree();
 }
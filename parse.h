@@ -13,4 +13,20 @@
  */
 TreeNode *parse(void);
 
+/* Function parseTokens parses the whole program in
+ * the stream ts as parse does, reporting its errors,
+ * but leaves the records in run rather than handing
+ * them to the arena
+ */
+void parseTokens(const TokenStream *ts, StatementRun *run);
+
+/* Function parseStatements parses the tokens
+ * [begin, end) of ts on their own as a statement
+ * sequence into run, reporting no errors; it returns
+ * FALSE, with run empty, unless they make one
+ * cleanly. parseTokens and parseStatements need the
+ * stream, so ScanWholeFile must be set.
+ */
+int parseStatements(const TokenStream *ts, int begin, int end, StatementRun *run);
+
 #endif
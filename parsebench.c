@@ -0,0 +1,130 @@
+/****************************************************/
+/* File: parsebench.c                               */
+/* Parser throughput benchmark for the TINY         */
+/* compiler: times parse over one source file with  */
+/* all listing output off, or the edits of an edit  */
+/* session; see the makefile                        */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "scan.h"
+#include "tree.h"
+#include "parse.h"
+#include "reparse.h"
+#include <time.h>
+
+/* the globals main.c would allocate */
+THREAD_LOCAL int lineno = 0;
+THREAD_LOCAL int tokenpos = 0;
+FILE *source;
+FILE *listing;
+FILE *code;
+
+int EchoSource = FALSE;
+int TraceScan = FALSE;
+int TraceParse = FALSE;
+int TraceAnalyze = FALSE;
+int TraceCode = FALSE;
+
+int ScanWholeFile = FALSE;
+int LexThreads = 1;
+int ParseThreads = 1;
+int ShareExps = FALSE;
+int OnePass = FALSE;
+
+int Error = FALSE;
+
+/* wallClock returns the time in seconds; parsing
+   on several threads takes CPU time on each */
+static double wallClock(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* editBench opens an edit session on the source and
+   times n edits spread over it, each changing a digit
+   and then changing it back, as typing over a number
+   would; it returns the time per edit */
+static double editBench(int n, long *edits) {
+	const char *src;
+	char *text;
+	size_t len, pos;
+	double start;
+	int i;
+	if (editOpen() == NULL || Error) return 0.0;
+	/* a copy to find the digits in, as asking for
+	   the source would close the gap an edit leaves */
+	src = sourceText(&len);
+	if ((text = (char *) malloc(len + 1)) == NULL) return 0.0;
+	memcpy(text, src, len);
+	*edits = 0;
+	start = wallClock();
+	for (i = 0; i < n; i++) {
+		char old, digit;
+		for (pos = len / n * i; pos < len && !isdigit((unsigned char) text[pos]); pos++)
+			;
+		if (pos == len) break;
+		old = text[pos];
+		digit = old == '9' ? '8' : old + 1;
+		editApply((int) pos, 1, &digit, 1);
+		editApply((int) pos, 1, &old, 1);
+		*edits += 2;
+	}
+	start = wallClock() - start;
+	free(text);
+	editClose();
+	return *edits ? start / *edits : 0.0;
+}
+
+int main(int argc, char *argv[]) {
+	long bytes, records = 0, edits = 0;
+	double start, secs;
+	TreeNode *t;
+	int nedits = 0;
+	if (argc == 4 && strcmp(argv[1], "--edits") == 0) {
+		nedits = atoi(argv[2]);
+		argv += 2;
+		argc -= 2;
+	} else if (argc == 3 && strcmp(argv[1], "--token-stream") == 0) {
+		ScanWholeFile = TRUE;
+		argv++;
+		argc--;
+	} else if (argc == 4 && strcmp(argv[1], "--parse-threads") == 0) {
+		ScanWholeFile = TRUE;
+		ParseThreads = atoi(argv[2]);
+		argv += 2;
+		argc -= 2;
+	}
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s [--token-stream | --parse-threads N | --edits N] <filename>\n",
+			argv[0]);
+		return 1;
+	}
+	source = fopen(argv[1], "r");
+	if (source == NULL) {
+		fprintf(stderr, "File %s not found\n", argv[1]);
+		return 1;
+	}
+	listing = stdout;
+	fseek(source, 0, SEEK_END);
+	bytes = ftell(source);
+	rewind(source);
+	if (nedits > 0) {
+		secs = editBench(nedits, &edits);
+		printf("%s: %ld bytes, %ld edits%s, %.1f us per edit\n", argv[1], bytes, edits,
+			Error ? " (errors)" : "", secs * 1e6);
+		fclose(source);
+		return 0;
+	}
+	start = wallClock();
+	for (t = parse(); t != NULL; t = nodeSibling(t)) records += t->size;
+	secs = wallClock() - start;
+	printf("%s: %ld bytes, %ld tree records%s, %.3f s, %.1f MB/s\n",
+		argv[1], bytes, records, Error ? " (syntax errors)" : "", secs,
+		secs > 0 ? bytes / secs / 1e6 : 0.0);
+	fclose(source);
+	return 0;
+}
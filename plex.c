@@ -0,0 +1,212 @@
+/****************************************************/
+/* File: plex.c                                     */
+/* Parallel lexing of large sources                 */
+/* for the TINY compiler                            */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "scan.h"
+#include "plex.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/* MAXCHUNKS = bound on the number of chunks */
+#define MAXCHUNKS 256
+
+/* Chunks start right after a newline. Identifiers,
+ * numbers, strings and two-character symbols never
+ * span a newline, so the scanner is either between
+ * tokens or inside a comment at a chunk start. Every
+ * chunk but the first is therefore lexed both ways,
+ * and the runs that follow the actual state are
+ * stitched together afterwards.
+ */
+typedef struct {
+	const char *begin, *end; /* the stretch of source */
+	int first, last;		 /* TRUE for the first and final chunk */
+	int lines;				 /* newlines in the chunk */
+	int failed;				 /* ran out of memory */
+	TokenStream normal;		 /* run starting between tokens */
+	int normalInComment;	 /* whether it ends inside a comment */
+	TokenStream comment;	 /* run starting inside a comment */
+	int commentFrom;		 /* >= 0: the comment run is normal from
+								this token on, and comment is unused */
+	int commentInComment;	 /* whether it ends inside a comment */
+} Chunk;
+
+/* findToken returns the index of the token of ts
+   whose lexeme starts at offset, or -1 */
+static int findToken(const TokenStream *ts, int offset) {
+	int lo = 0, hi = ts->count - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (ts->offset[mid] < offset)
+			lo = mid + 1;
+		else if (ts->offset[mid] > offset)
+			hi = mid - 1;
+		else {
+			/* an empty lexeme may share the offset; take the first */
+			while (mid > 0 && ts->offset[mid - 1] == offset) mid--;
+			return mid;
+		}
+	}
+	return -1;
+}
+
+/* lexChunk lexes one chunk in both starting states */
+static void *lexChunk(void *arg) {
+	Chunk *c = (Chunk *) arg;
+	const char *rbrace;
+	int lines, r;
+	r = scanChunk(c->begin, c->end, FALSE, c->last, &c->normal, &c->lines);
+	if (r < 0) {
+		c->failed = TRUE;
+		return NULL;
+	}
+	c->normalInComment = r;
+	c->commentFrom = -1;
+	if (c->first) return NULL;
+	/* a comment open at the chunk start ends at the first
+	   '}'; if the normal run took that '}' as a stray
+	   character, both runs agree from the next token on */
+	rbrace = (const char *) memchr(c->begin, '}', c->end - c->begin);
+	if (rbrace != NULL) {
+		int i = findToken(&c->normal, (int) (rbrace - c->normal.text));
+		if (i >= 0 && c->normal.kind[i] == ERROR && c->normal.err[i] == 1 &&
+			c->normal.length[i] == 1) {
+			c->commentFrom = i + 1;
+			c->commentInComment = c->normalInComment;
+			return NULL;
+		}
+	}
+	r = scanChunk(c->begin, c->end, TRUE, c->last, &c->comment, &lines);
+	if (r < 0)
+		c->failed = TRUE;
+	else
+		c->commentInComment = r;
+	return NULL;
+}
+
+static void freeChunk(Chunk *c) {
+	free(c->normal.kind);
+	free(c->normal.err);
+	free(c->normal.offset);
+	free(c->normal.length);
+	free(c->normal.line);
+	free(c->normal.sym);
+	free(c->comment.kind);
+	free(c->comment.err);
+	free(c->comment.offset);
+	free(c->comment.length);
+	free(c->comment.line);
+	free(c->comment.sym);
+}
+
+/* merge stitches the runs that follow the actual
+   state at each chunk start into one stream */
+static TokenStream *merge(Chunk *chunk, int n, int err) {
+	TokenStream *ts = (TokenStream *) calloc(1, sizeof(TokenStream));
+	const TokenStream *run[MAXCHUNKS];
+	int from[MAXCHUNKS];
+	int inComment = FALSE, total = 0, base = 0, k, i;
+	if (ts == NULL) return NULL;
+	for (k = 0; k < n; k++) {
+		Chunk *c = &chunk[k];
+		if (!inComment || c->commentFrom >= 0) {
+			run[k] = &c->normal;
+			from[k] = inComment ? c->commentFrom : 0;
+			inComment = c->normalInComment;
+		} else {
+			run[k] = &c->comment;
+			from[k] = 0;
+			inComment = c->commentInComment;
+		}
+		total += run[k]->count - from[k];
+	}
+	ts->kind = (unsigned char *) malloc(total);
+	ts->err = (unsigned char *) malloc(total);
+	ts->offset = (int *) malloc(total * sizeof(int));
+	ts->length = (int *) malloc(total * sizeof(int));
+	ts->line = (int *) malloc(total * sizeof(int));
+	ts->sym = (SymId *) malloc(total * sizeof(SymId));
+	if (!ts->kind || !ts->err || !ts->offset || !ts->length || !ts->line || !ts->sym) {
+		freeTokenStream(ts);
+		return NULL;
+	}
+	ts->text = chunk[0].normal.text;
+	ts->size = total;
+	for (k = 0; k < n; k++) {
+		const TokenStream *r = run[k];
+		int m = r->count - from[k];
+		if (m <= 0) {
+			base += chunk[k].lines;
+			continue;
+		}
+		memcpy(ts->kind + ts->count, r->kind + from[k], m);
+		memcpy(ts->offset + ts->count, r->offset + from[k], m * sizeof(int));
+		memcpy(ts->length + ts->count, r->length + from[k], m * sizeof(int));
+		memcpy(ts->sym + ts->count, r->sym + from[k], m * sizeof(SymId));
+		for (i = 0; i < m; i++) {
+			ts->line[ts->count + i] = r->line[from[k] + i] + base;
+			/* an error that does not set errortype
+			   leaves the previous one in place */
+			if (r->kind[from[k] + i] == ERROR && r->err[from[k] + i] != 0)
+				err = r->err[from[k] + i];
+			ts->err[ts->count + i] = (r->kind[from[k] + i] == ERROR) ? err : 0;
+		}
+		ts->count += m;
+		base += chunk[k].lines;
+	}
+	return ts;
+}
+
+TokenStream *scanParallel(const char *text, size_t len, int nthreads, int err) {
+#ifdef HAVE_PTHREAD
+	Chunk *chunk;
+	pthread_t thread[MAXCHUNKS];
+	int started[MAXCHUNKS];
+	TokenStream *ts = NULL;
+	const char *p = text, *end = text + len;
+	int n = 0, k, failed = FALSE;
+	if (nthreads > MAXCHUNKS) nthreads = MAXCHUNKS;
+	if ((size_t) nthreads > len / MINCHUNK) nthreads = (int) (len / MINCHUNK);
+	if (nthreads < 2) return NULL;
+	chunk = (Chunk *) calloc(nthreads, sizeof(Chunk));
+	if (chunk == NULL) return NULL;
+	/* cut the text into chunks ending at newlines */
+	while (p < end && n < nthreads) {
+		const char *e = (n == nthreads - 1) ? end : text + len / nthreads * (n + 1);
+		if (e < p) e = p;
+		if (e < end) {
+			e = (const char *) memchr(e, '\n', end - e);
+			e = (e == NULL) ? end : e + 1;
+		}
+		chunk[n].begin = p;
+		chunk[n].end = e;
+		n++;
+		p = e;
+	}
+	chunk[0].first = TRUE;
+	chunk[n - 1].last = TRUE;
+	for (k = 1; k < n; k++)
+		started[k] = pthread_create(&thread[k], NULL, lexChunk, &chunk[k]) == 0;
+	lexChunk(&chunk[0]);
+	for (k = 1; k < n; k++)
+		if (started[k])
+			pthread_join(thread[k], NULL);
+		else
+			lexChunk(&chunk[k]);
+	for (k = 0; k < n; k++) failed |= chunk[k].failed;
+	if (!failed) ts = merge(chunk, n, err);
+	for (k = 0; k < n; k++) freeChunk(&chunk[k]);
+	free(chunk);
+	return ts;
+#else
+	return NULL;
+#endif
+}
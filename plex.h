@@ -0,0 +1,26 @@
+/****************************************************/
+/* File: plex.h                                     */
+/* Parallel lexing interface for the TINY compiler  */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _PLEX_H_
+#define _PLEX_H_
+
+/* MINCHUNK = smallest stretch of source worth
+   lexing on a thread of its own */
+#ifndef MINCHUNK
+#define MINCHUNK 65536
+#endif
+
+/* Function scanParallel tokenizes the len characters
+ * of text, split into chunks lexed on up to nthreads
+ * threads, into one TokenStream equal to what scanning
+ * it token by token gives; err is the errortype before
+ * the scan. It returns NULL when the text is too small
+ * to split or threads are unavailable.
+ */
+TokenStream *scanParallel(const char *text, size_t len, int nthreads, int err);
+
+#endif
@@ -0,0 +1,369 @@
+/****************************************************/
+/* File: reparse.c                                  */
+/* Incremental reparsing and checking of an edited  */
+/* source for the TINY compiler                     */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "scan.h"
+#include "tree.h"
+#include "parse.h"
+#include "symtab.h"
+#include "analyze.h"
+#include "reparse.h"
+
+/* the token stream of the whole source, and the
+   tree, in an array of the session's own */
+static TokenStream *stream = NULL;
+static TreeNode *tree = NULL;
+static unsigned ntree = 0, treeSize = 0;
+
+/* declEnd is the first token after the declarations */
+static int declEnd = 0;
+
+/* clean is TRUE while the tree and the symbol table
+   are those of a source without errors, which an
+   edit can be made good in */
+static int clean = FALSE;
+
+/* The records, and the occurrences in the symbol
+   table, keep the positions before splitLo as
+   offsets and those from splitHi on from the end,
+   as the tokens they were parsed from did; an edit
+   makes good only those between it and the last.
+   mark is a top-level statement at or before them. */
+static int splitLo = INT_MAX, splitHi = INT_MAX;
+static unsigned mark = 0;
+
+/* LOST is the position of a record whose token the
+   edit replaced */
+#define LOST INT_MIN
+
+/* Unit is a part of the tree an edit may be made
+   good in: the records [rec, rec + nrec), the
+   statements of one sequence, parsed from the
+   tokens [begin, end); last is the record of the
+   last of them, and path[0 .. depth) the records of
+   the statements it lies in */
+typedef struct {
+	unsigned rec, nrec, last;
+	int begin, end;
+	int depth;
+} Unit;
+
+/* the units about the edit, outermost first, and
+   the path to the innermost */
+static Unit *unit = NULL;
+static unsigned *path = NULL;
+static int unitSize = 0;
+
+/* nextRecord is the record after t, skipping the
+   text of a StrK */
+#define nextRecord(t) (((t)->nodekind == ExpK && (t)->kind.exp == StrK) ? (t) + (t)->size : (t) + 1)
+
+/* startOf is the source offset of record t */
+#define startOf(t) sourceOffset((t)->pos)
+
+/* tokenAt returns the first token starting at
+   offset pos or later */
+static int tokenAt(int pos) {
+	int lo = 0, hi = stream->count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (sourceOffset(tokenPos(stream, mid)) >= pos)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+/* fullPass parses and checks the whole source again */
+static TreeNode *fullPass(void) {
+	StatementRun run;
+	st_clear();
+	Error = FALSE;
+	closeGap(stream);
+	parseTokens(stream, &run);
+	free(tree);
+	tree = run.rec;
+	ntree = treeSize = run.count;
+	splitLo = splitHi = INT_MAX;
+	mark = 0;
+	declEnd = ntree ? tokenAt(startOf(tree)) : stream->count - 1;
+	if (!Error && ntree) analyze(tree);
+	clean = !Error;
+	return ntree ? tree : NULL;
+}
+
+TreeNode *editOpen(void) {
+	editClose();
+	ScanWholeFile = TRUE;
+	if ((stream = scanAll()) == NULL) {
+		Error = TRUE;
+		return NULL;
+	}
+	return fullPass();
+}
+
+void editClose(void) {
+	freeTokenStream(stream);
+	free(tree);
+	free(unit);
+	free(path);
+	stream = NULL;
+	tree = NULL;
+	unit = NULL;
+	path = NULL;
+	ntree = treeSize = 0;
+	unitSize = 0;
+	clean = FALSE;
+}
+
+/* the child slots holding sequences, by StmtKind */
+static const int seqSlot[][2] = {{1, 2}, {0, -1}, {-1, -1}, {-1, -1}, {-1, -1}, {1, -1}};
+
+/* seekRecord returns the innermost statement
+   starting at or before offset x, or the first if
+   none does; every record before it is before x.
+   The top-level statements are gone through from
+   mark on if it is before x, and mark is left at
+   the one before the last of them starting at or
+   before x, which findUnits starts from. */
+static TreeNode *seekRecord(int x) {
+	TreeNode *s = tree + mark, *prev, *next, *c;
+	int i, k;
+	if (startOf(s) > x) s = tree;
+	for (prev = s; (next = nodeSibling(s)) != NULL && startOf(next) <= x; s = next) prev = s;
+	mark = (unsigned) (prev - tree);
+	while (startOf(s) <= x) {
+		/* down into the last sequence starting by x */
+		for (c = NULL, i = 0; i < 2; i++)
+			if ((k = seqSlot[s->kind.stmt][i]) >= 0 && (next = nodeChild(s, k)) != NULL &&
+				startOf(next) <= x)
+				c = next;
+		if (c == NULL) break;
+		for (s = c; (next = nodeSibling(s)) != NULL && startOf(next) <= x;) s = next;
+	}
+	return s;
+}
+
+/* moveSplit readies the records and the symbol
+   table for an edit that replaces [start, end): it
+   keeps the positions before start as offsets and
+   those after end from the end, going over only the
+   records between the edit and the last one. Those
+   that started inside it get pos LOST, as no token
+   is known for them, and their uses go; it returns
+   their number. */
+static int moveSplit(int start, int end) {
+	TreeNode *t, *e = tree + ntree;
+	int lo = splitLo < start ? splitLo : start;
+	int hi = splitHi > end ? splitHi : end;
+	int lost = 0, x, pos;
+	for (t = seekRecord(lo); t < e; t = nextRecord(t)) {
+		x = startOf(t);
+		if (t->nodekind == StmtK && x >= hi) break;
+		if (x < lo || x >= hi) continue;
+		pos = x < start ? x : x >= end ? endPos(x) : LOST;
+		if (pos == t->pos) continue;
+		if ((t->nodekind == StmtK && (t->kind.stmt == AssignK || t->kind.stmt == ReadK)) ||
+			(t->nodekind == ExpK && t->kind.exp == IdK)) {
+			if (pos == LOST)
+				st_dropline(t->attr.sym, t->pos);
+			else
+				st_repos(t->attr.sym, t->pos, pos);
+		}
+		if (pos == LOST) lost++;
+		t->pos = pos;
+	}
+	return lost;
+}
+
+/* the records of a unit fall into three kinds: those
+   before the tokens scanned again, whose tokens are
+   [0, first), those after them, and the dirty ones */
+#define before(t, e) ((t)->pos != LOST && startOf(t) < (e)->begin)
+#define after(t, e) ((t)->pos != LOST && startOf(t) >= (e)->newEnd)
+
+/* pushUnit adds a unit after the n so far; FALSE if
+   out of memory */
+static int pushUnit(int n, TreeNode *first, TreeNode *last, int begin, int end) {
+	Unit *u;
+	if (n == unitSize) {
+		int k = unitSize ? 2 * unitSize : 64;
+		Unit *p = (Unit *) realloc(unit, k * sizeof(Unit));
+		unsigned *q;
+		if (p != NULL) unit = p;
+		q = (unsigned *) realloc(path, k * sizeof(unsigned));
+		if (q != NULL) path = q;
+		if (p == NULL || q == NULL) return FALSE;
+		unitSize = k;
+	}
+	u = &unit[n];
+	u->rec = (unsigned) (first - tree);
+	u->nrec = (unsigned) (last + last->size - first);
+	u->last = (unsigned) (last - tree);
+	u->begin = begin;
+	u->end = end;
+	u->depth = n;
+	if (n > 0) path[n - 1] = unit[n - 1].rec;
+	return TRUE;
+}
+
+/* seqEnd returns the token ending the sequence of
+   statements in child slot k of s, which is parsed
+   from the tokens [begin, end); -1 if the tree does
+   not tell it for sure */
+static int seqEnd(TreeNode *s, int k, int end, const TokenEdit *e) {
+	TreeNode *c, *t;
+	int pos = INT_MAX, i;
+	if (s->kind.stmt == IfK && k == 1 && (s->flags & CHILD(2))) {
+		/* the else before the other sequence */
+		c = nodeChild(s, 2);
+		i = after(c, e) ? tokenAt(startOf(c)) - 1 : 0;
+		return tokenKind(stream, i) == ELSE ? i : -1;
+	}
+	if (s->kind.stmt != RepeatK)
+		/* the end of the statement */
+		return tokenKind(stream, end - 1) == END ? end - 1 : -1;
+	/* the until before the test, which starts at its
+	   first token but for parentheses */
+	c = nodeChild(s, 1);
+	for (t = c; t < c + c->size; t = nextRecord(t)) {
+		if (!after(t, e)) return -1;
+		if (startOf(t) < pos) pos = startOf(t);
+	}
+	for (i = tokenAt(pos) - 1; i > 0 && tokenKind(stream, i) == LPAREN; i--)
+		;
+	return tokenKind(stream, i) == UNTIL ? i : -1;
+}
+
+/* findUnits lists the units about the edit e from
+   the run of top-level statements it touches down to
+   the innermost statement around it, and returns
+   their number; 0 if there is none */
+static int findUnits(const TokenEdit *e) {
+	int dirtyEnd = e->first + e->added, n = 0, i, begin, end;
+	TreeNode *first = NULL, *last, *next, *s;
+	/* the run: from the last statement before the
+	   edit to the last before a clean ';' after it */
+	s = before(tree + mark, e) ? tree + mark : tree;
+	for (; s != NULL && before(s, e); s = nodeSibling(s)) first = s;
+	begin = first ? tokenAt(startOf(first)) : declEnd;
+	last = first ? first : tree;
+	while ((next = nodeSibling(last)) != NULL &&
+		   (!after(next, e) || tokenAt(startOf(next)) - 1 < dirtyEnd))
+		last = next;
+	end = next ? tokenAt(startOf(next)) - 1 : stream->count - 1;
+	if (!pushUnit(n++, first ? first : tree, last, begin, end)) return 0;
+	/* down through the statements around it */
+	for (s = first; s != NULL && s == last;) {
+		TreeNode *found = NULL;
+		int cend = -1;
+		for (i = 0; i < 2 && found == NULL; i++) {
+			int k = seqSlot[s->kind.stmt][i], term;
+			TreeNode *c, *head;
+			if (k < 0 || (head = nodeChild(s, k)) == NULL) continue;
+			if ((term = seqEnd(s, k, end, e)) < 0) continue;
+			for (c = NULL, next = head; next != NULL && before(next, e); next = nodeSibling(next))
+				c = next;
+			if (c == NULL) continue;
+			if (next == NULL)
+				cend = term;
+			else
+				cend = after(next, e) ? tokenAt(startOf(next)) - 1 : -1;
+			if (cend >= dirtyEnd) found = c;
+		}
+		if (found == NULL) break;
+		s = last = found;
+		begin = tokenAt(startOf(s));
+		end = cend;
+		if (!pushUnit(n++, s, s, begin, end)) return n - 1;
+	}
+	return n;
+}
+
+/* dropUses forgets the uses the records of u record */
+static void dropUses(const Unit *u) {
+	TreeNode *t, *e = tree + u->rec + u->nrec;
+	for (t = tree + u->rec; t < e; t = nextRecord(t))
+		if (t->pos != LOST &&
+			((t->nodekind == StmtK && (t->kind.stmt == AssignK || t->kind.stmt == ReadK)) ||
+				(t->nodekind == ExpK && t->kind.exp == IdK)))
+			st_dropline(t->attr.sym, t->pos);
+}
+
+/* splice puts the records of run in the place of
+   those of u, a child of the statements on path */
+static int splice(const Unit *u, StatementRun *run) {
+	int diff = (int) run->count - (int) u->nrec, i;
+	int sibling = tree[u->last].flags & SIBLING;
+	if (ntree + diff > treeSize) {
+		unsigned n = 2 * (ntree + diff);
+		TreeNode *p = (TreeNode *) realloc(tree, n * sizeof(TreeNode));
+		if (p == NULL) return FALSE;
+		tree = p;
+		treeSize = n;
+	}
+	if (diff != 0)
+		memmove(tree + u->rec + run->count, tree + u->rec + u->nrec,
+			(ntree - u->rec - u->nrec) * sizeof(TreeNode));
+	memcpy(tree + u->rec, run->rec, run->count * sizeof(TreeNode));
+	tree[u->rec + run->last].flags |= sibling;
+	for (i = 0; i < u->depth; i++) tree[path[i]].size += diff;
+	ntree += diff;
+	/* the statements after the unit may have moved */
+	mark = unit[0].rec;
+	return TRUE;
+}
+
+/* reparse makes the edit e good in the smallest unit
+   that parses cleanly; FALSE if none does */
+static int reparse(const TokenEdit *e) {
+	StatementRun run;
+	Unit *u = NULL;
+	int n = findUnits(e), d;
+	for (d = n - 1; d >= 0; d--) {
+		u = &unit[d];
+		/* expressions are shared within straight-line
+		   code, which only whole ifs, whiles and
+		   repeats are sure to bound */
+		if (ShareExps && (u->nrec != tree[u->rec].size || tree[u->rec].nodekind != StmtK ||
+							 (tree[u->rec].kind.stmt != IfK && tree[u->rec].kind.stmt != WhileK &&
+								 tree[u->rec].kind.stmt != RepeatK)))
+			continue;
+		if (parseStatements(stream, u->begin, u->end, &run)) break;
+	}
+	if (d < 0) return FALSE;
+	dropUses(u);
+	analyze(run.rec);
+	if (!splice(u, &run)) {
+		free(run.rec);
+		return FALSE;
+	}
+	free(run.rec);
+	clean = !Error;
+	return TRUE;
+}
+
+TreeNode *editApply(int start, int oldLen, const char *text, int newLen) {
+	TokenEdit e;
+	int lost = 0;
+	if (stream == NULL) return NULL;
+	if (clean && ntree > 0) lost = moveSplit(start, start + oldLen);
+	if (!relexEdit(stream, start, oldLen, text, newLen, &e)) {
+		fprintf(listing, "Edit error: cannot replace %d bytes at offset %d\n", oldLen, start);
+		Error = TRUE;
+		editClose();
+		return NULL;
+	}
+	if (clean && ntree > 0 && e.first >= declEnd) {
+		splitLo = start;
+		splitHi = e.newEnd;
+		if ((e.same && lost == 0) || reparse(&e)) return tree;
+	}
+	return fullPass();
+}
@@ -0,0 +1,41 @@
+/****************************************************/
+/* File: reparse.h                                  */
+/* Incremental reparsing and checking of an edited  */
+/* source for the TINY compiler                     */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _REPARSE_H_
+#define _REPARSE_H_
+
+/* An edit session keeps the token stream, the tree
+ * and the symbol table of the source between edits
+ * (there is only one session). After an edit only
+ * the lines about it are scanned again, and only the
+ * innermost statement around it, or the run of
+ * top-level statements it touches, is parsed again,
+ * spliced into the tree and checked. Diagnostics are
+ * reported as a full compilation would report them,
+ * and Error tells whether the source as edited has
+ * any.
+ */
+
+/* Function editOpen compiles the source as far as
+ * type checking, which it does as main does, and
+ * starts the session; it returns the tree, NULL if
+ * there is none
+ */
+TreeNode *editOpen(void);
+
+/* Function editApply replaces the bytes [start, start
+ * + oldLen) of the source by the newLen bytes at text
+ * and returns the tree brought up to date, which may
+ * have moved; NULL if there is none
+ */
+TreeNode *editApply(int start, int oldLen, const char *text, int newLen);
+
+/* Procedure editClose ends the session */
+void editClose(void);
+
+#endif
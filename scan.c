@@ -8,6 +8,23 @@
 #include "globals.h"
 #include "util.h"
 #include "scan.h"
+#include "keyhash.h"
+#include "simd.h"
+#include "plex.h"
+#include "intern.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <unistd.h>
+
+/* set TABLE_SCAN to TRUE to get the table-driven
+   scanner core instead of the switch-based one */
+#ifndef TABLE_SCAN
+#define TABLE_SCAN FALSE
+#endif
 
 /* states in scanner DFA */
 typedef enum { START,
@@ -20,80 +37,461 @@ typedef enum { START,
 	INLE,
 	INGE } StateType;
 
-/* lexeme of identifier or reserved word */
-char tokenString[MAXTOKENLEN + 1];
-
-/* BUFLEN = length of the input buffer for
-   source code lines */
-#define BUFLEN 256
-
-static char lineBuf[BUFLEN]; /* holds the current line */
-static int linepos = 0;		 /* current position in LineBuf */
-static int bufsize = 0;		 /* current size of buffer string */
-static int EOF_flag = FALSE; /* corrects ungetNextChar behavior on EOF */
-
-/* getNextChar fetches the next non-blank character
-   from lineBuf, reading in a new line if lineBuf is
-   exhausted */
-static int getNextChar(void) {
-	if (!(linepos < bufsize)) {
-		lineno++;
-		if (fgets(lineBuf, BUFLEN - 1, source)) {
-			if (EchoSource) fprintf(listing, "%4d: %s", lineno, lineBuf);
-			bufsize = strlen(lineBuf);
-			linepos = 0;
-			return lineBuf[linepos++];
+/* lexeme of the last token, a view into the source */
+const char *tokenString = "";
+int tokenLength = 0;
+
+/* interned id of the last ID token */
+SymId tokenSym = NOSYM;
+
+/* the whole source file is held in one buffer: it is
+   mapped with mmap when the source is a regular file,
+   otherwise it is filled by read() (pipes, terminals) */
+static char *srcBuf = NULL;	/* start of the source text */
+static size_t srcLen = 0;	/* its length */
+static size_t srcMapLen = 0; /* length of the mapping, 0 if not mapped */
+static size_t srcCap = 0;	 /* allocated length when not mapped */
+
+/* an edit leaves a gap in the buffer at offset
+   srcGap: the text after it lies at the end */
+static size_t srcGap = 0;
+#define gapLength() (srcMapLen ? 0 : srcCap - srcLen)
+
+/* the newline index: lineStart[k] is the offset of
+   the first character of line k + 1, and there is
+   one more line than there are newlines. An edit
+   leaves a gap at line lineGap: the lines after it
+   lie at the end of the array, kept from the end */
+static int *lineStart = NULL;
+static int nlines = 0, lineCap = 0, lineGap = 0;
+
+/* lineAt is the offset line k + 1 starts at */
+#define lineAt(k) ((k) < lineGap ? lineStart[k] : sourceOffset(lineStart[(k) + lineCap - nlines]))
+
+/* ScanState is the state of one scan over a stretch
+   of the source buffer: the main scan covers the
+   whole file, parallel lexing runs one per chunk */
+typedef struct {
+	char *pos;		   /* next character to be scanned */
+	char *end;		   /* one past the end of the stretch */
+	char *lineEnd;	   /* one past the end of the current line */
+	int eof;		   /* corrects ungetNextChar behavior on EOF */
+	int lineno;		   /* number of the current line */
+	int lineBase;	   /* lineStart index of line 1, less 1 */
+	int echo;		   /* echo lines to the listing as entered */
+	int errortype;	   /* kind of the last lexical error */
+	StateType resume;  /* state the next token starts in */
+	char *lexemeStart; /* where the last lexeme lies in the buffer */
+	int lexemeLen;	   /* and its length */
+} ScanState;
+
+/* the scan behind getToken */
+static ScanState mainScan;
+static int mainScanReady = FALSE;
+
+/* READCHUNK = initial size of the read() buffer
+   used when the source cannot be mapped */
+#define READCHUNK 65536
+
+/* loadSource brings the whole source file into
+   srcBuf; it returns FALSE if the file cannot be read */
+static int loadSource(void) {
+	int fd = fileno(source);
+	size_t cap, len = 0;
+	ssize_t n;
+#ifdef HAVE_MMAP
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			srcBuf = (char *) p;
+			srcLen = srcGap = srcMapLen = (size_t) st.st_size;
+			return TRUE;
+		}
+	}
+#endif
+	cap = READCHUNK;
+	srcBuf = (char *) malloc(cap);
+	while (srcBuf != NULL && (n = read(fd, srcBuf + len, cap - len)) > 0) {
+		len += (size_t) n;
+		if (len == cap) {
+			char *p = (char *) realloc(srcBuf, cap *= 2);
+			if (p == NULL) free(srcBuf);
+			srcBuf = p;
+		}
+	}
+	if (srcBuf == NULL) {
+		fprintf(listing, "Out of memory error reading source\n");
+		return FALSE;
+	}
+	srcLen = srcGap = len;
+	srcCap = cap;
+	return TRUE;
+}
+
+/* moveGap moves the gap in the source buffer to
+   offset to, moving the text between */
+static void moveGap(size_t to) {
+	size_t g = gapLength();
+	if (to < srcGap)
+		memmove(srcBuf + to + g, srcBuf + to, srcGap - to);
+	else
+		memmove(srcBuf + srcGap, srcBuf + srcGap + g, to - srcGap);
+	srcGap = to;
+}
+
+/* buildLineIndex fills the newline index with a
+   counting and a listing pass of the SIMD kernels */
+static int buildLineIndex(void) {
+	long n = srcBuf ? countNewlines(srcBuf, srcBuf + srcLen) : 0;
+	lineStart = (int *) malloc((n + 1) * sizeof(int));
+	if (lineStart == NULL) {
+		fprintf(listing, "Out of memory error reading source\n");
+		return FALSE;
+	}
+	lineStart[0] = 0;
+	if (n > 0) {
+		int k;
+		listNewlines(srcBuf, srcBuf + srcLen, lineStart + 1);
+		for (k = 1; k <= n; k++) lineStart[k]++;
+	}
+	nlines = lineCap = lineGap = (int) n + 1;
+	return TRUE;
+}
+
+/* lineIndex returns the index k >= lo of the line
+   holding offset pos, by binary search */
+static int lineIndex(int pos, int lo) {
+	int hi = nlines - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (lineAt(mid) <= pos)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+/* lineLimit returns one past the end of line index
+   k, cut off at the end of the stretch s scans */
+static char *lineLimit(ScanState *s, int k) {
+	char *e = (k + 1 < nlines) ? srcBuf + lineAt(k + 1) : srcBuf + srcLen;
+	return e < s->end ? e : s->end;
+}
+
+int sourceOffset(int pos) {
+	return pos >= 0 ? pos : pos + (int) srcLen + 1;
+}
+
+int endPos(int offset) {
+	return offset - (int) srcLen - 1;
+}
+
+/* Function sourceLine returns the number of the line
+ * holding the position pos of the source, and
+ * sourceColumn its column, both counted from 1
+ */
+int sourceLine(int pos) {
+	return nlines ? lineIndex(sourceOffset(pos), 0) + 1 : 1;
+}
+
+int sourceColumn(int pos) {
+	pos = sourceOffset(pos);
+	return nlines ? pos - lineAt(lineIndex(pos, 0)) + 1 : pos + 1;
+}
+
+const char *sourceAt(int pos) {
+	size_t x = (size_t) sourceOffset(pos);
+	return srcBuf + x + (x < srcGap ? 0 : gapLength());
+}
+
+/* enterLine makes the line starting at s->pos the
+   current one: it bumps the line number, takes the
+   end of the line from the index and echoes it if
+   s->echo is set */
+static void enterLine(ScanState *s) {
+	s->lineno++;
+	s->lineEnd = lineLimit(s, s->lineno + s->lineBase);
+	if (s->echo) {
+		fprintf(listing, "%4d: ", s->lineno);
+		fwrite(s->pos, 1, s->lineEnd - s->pos, listing);
+	}
+}
+
+/* getNextChar fetches the next character from the
+   source buffer, entering a new line when the
+   current one is exhausted */
+static int getNextChar(ScanState *s) {
+	if (!(s->pos < s->lineEnd)) {
+		if (s->pos < s->end) {
+			enterLine(s);
+			return *s->pos++;
 		} else {
-			EOF_flag = TRUE;
+			s->lineno++;
+			s->eof = TRUE;
 			return EOF;
 		}
 	} else
-		return lineBuf[linepos++];
+		return *s->pos++;
 }
 
 /* ungetNextChar backtracks one character
-   in lineBuf */
-static void ungetNextChar(void) {
-	if (!EOF_flag) linepos--;
+   in the source buffer */
+static void ungetNextChar(ScanState *s) {
+	if (!s->eof) s->pos--;
 }
 
-/* lookup table of reserved words */
-static struct
-{
-	char *str;
+/* advanceTo moves s->pos forward to p, entering
+   every line that starts before p just as reading
+   the characters one by one would: the current
+   line becomes the one holding p - 1 */
+static void advanceTo(ScanState *s, char *p) {
+	if (p > s->lineEnd) {
+		if (s->echo)
+			while (s->lineEnd < p) {
+				s->pos = s->lineEnd;
+				enterLine(s);
+			}
+		else {
+			int k = lineIndex((int) (p - 1 - srcBuf), s->lineno + s->lineBase);
+			s->lineno = k - s->lineBase;
+			s->lineEnd = lineLimit(s, k);
+		}
+	}
+	s->pos = p;
+}
+
+/* skipBlanks and skipComment jump over the rest of a
+   run of blanks or of a comment body with a SIMD
+   kernel, stopping before the character ending it */
+static void skipBlanks(ScanState *s) {
+	advanceTo(s, (char *) skipRun(RUN_BLANKS, s->pos, s->end));
+}
+
+static void skipComment(ScanState *s) {
+	advanceTo(s, (char *) skipRun(RUN_COMMENT, s->pos, s->end));
+}
+
+/* The saved characters of a lexeme are always
+   contiguous in the source buffer, so the lexeme is
+   kept as a view (lexemeStart, lexemeLen) and never
+   copied. saveChar adds the character just read */
+static void saveChar(ScanState *s) {
+	if (s->lexemeLen++ == 0) s->lexemeStart = s->pos - 1;
+}
+
+/* saveRun adds the characters [s->pos, p) to the
+   lexeme in one step and moves s->pos to p */
+static void saveRun(ScanState *s, char *p) {
+	if (s->lexemeLen == 0) s->lexemeStart = s->pos;
+	s->lexemeLen += (int) (p - s->pos);
+	s->pos = p;
+}
+
+/* scanStringBody saves the rest of a string body,
+   which never crosses a line, into the lexeme */
+static void scanStringBody(ScanState *s) {
+	saveRun(s, (char *) skipRun(RUN_STRING, s->pos, s->lineEnd));
+}
+
+/* reservedLookup checks whether the identifier s of
+   length len is a reserved word: one probe of the
+   perfect hash table generated into keyhash.h,
+   then one memcmp to confirm */
+static TokenType reservedLookup(char *s, int len) {
+	int h = KEYHASH(s, len);
+	if (keyTable[h].len == len && !memcmp(s, keyTable[h].str, len))
+		return keyTable[h].tok;
+	return ID;
+}
+
+#if TABLE_SCAN
+
+/* character classes of the table-driven scanner;
+   each special symbol has a class of its own */
+typedef enum { C_OTHER,
+	C_DIGIT,
+	C_LETTER,
+	C_BLANK,
+	C_NEWLINE,
+	C_LBRACE,
+	C_RBRACE,
+	C_QUOTE,
+	C_COLON,
+	C_LT,
+	C_GT,
+	C_EQ,
+	C_COMMA,
+	C_PLUS,
+	C_MINUS,
+	C_TIMES,
+	C_OVER,
+	C_LPAREN,
+	C_RPAREN,
+	C_SEMI,
+	C_EOF,
+	NCLASSES } CharClass;
+
+/* a transition of the scanner DFA: the next state,
+   whether the character is saved to the lexeme or
+   given back, the lexical error (errortype) it
+   raises, and the token recognized on reaching DONE */
+typedef struct {
+	unsigned char next;
+	unsigned char save;
+	unsigned char unget;
+	unsigned char err;
 	TokenType tok;
-} reservedWords[MAXRESERVED] = { { "if", IF }, { "then", THEN }, { "else", ELSE }, { "end", END },
-	{ "repeat", REPEAT }, { "until", UNTIL }, { "read", READ },
-	{ "write", WRITE },
-	{ "true", BTRUE }, { "false", BFALSE }, { "or", OR }, { "and", AND }, { "not", NOT }, { "int", INT }, { "bool", BOOL },
-	{ "string", STRING }, { "while", WHILE }, { "do", DO } };
-
-/* lookup an identifier to see if it is a reserved word */
-/* uses linear search */
-static TokenType reservedLookup(char *s) {
+} Transition;
+
+#define NSTATES (INGE + 1)
+
+static unsigned char charClass[256];
+static Transition transTable[NSTATES][NCLASSES];
+static int tablesBuilt = FALSE;
+
+/* setRow makes every class of state s take
+   the given transition */
+static void setRow(StateType s, StateType next, int save, int unget, TokenType tok, int err) {
+	int c;
+	for (c = 0; c < NCLASSES; c++)
+		transTable[s][c] = (Transition) { next, save, unget, err, tok };
+}
+
+/* setMove overrides the transition of state s
+   on character class c */
+static void setMove(StateType s, CharClass c, StateType next, int save, TokenType tok, int err) {
+	transTable[s][c] = (Transition) { next, save, FALSE, err, tok };
+}
+
+/* buildTables fills the character class table and
+   the transition table; they encode exactly the
+   DFA of the switch-based scanner */
+static void buildTables(void) {
+	static const struct
+	{
+		char c;
+		CharClass cls;
+		TokenType tok;
+	} symbols[] = { { '=', C_EQ, EQ }, { ',', C_COMMA, COMMA }, { '+', C_PLUS, PLUS },
+		{ '-', C_MINUS, MINUS }, { '*', C_TIMES, TIMES }, { '/', C_OVER, OVER },
+		{ '(', C_LPAREN, LPAREN }, { ')', C_RPAREN, RPAREN }, { ';', C_SEMI, SEMI } };
 	int i;
-	for (i = 0; i < MAXRESERVED; i++)
-		if (!strcmp(s, reservedWords[i].str))
-			return reservedWords[i].tok;
-	return ID;
+	for (i = '0'; i <= '9'; i++) charClass[i] = C_DIGIT;
+	for (i = 'a'; i <= 'z'; i++) charClass[i] = C_LETTER;
+	for (i = 'A'; i <= 'Z'; i++) charClass[i] = C_LETTER;
+	charClass[' '] = charClass['\t'] = C_BLANK;
+	charClass['\n'] = C_NEWLINE;
+	charClass['{'] = C_LBRACE;
+	charClass['}'] = C_RBRACE;
+	charClass['\''] = C_QUOTE;
+	charClass[':'] = C_COLON;
+	charClass['<'] = C_LT;
+	charClass['>'] = C_GT;
+
+	setRow(START, DONE, TRUE, FALSE, ERROR, 1);
+	setMove(START, C_DIGIT, INNUM, TRUE, ERROR, 0);
+	setMove(START, C_LETTER, INID, TRUE, ERROR, 0);
+	setMove(START, C_COLON, INASSIGN, TRUE, ERROR, 0);
+	setMove(START, C_BLANK, START, FALSE, ERROR, 0);
+	setMove(START, C_NEWLINE, START, FALSE, ERROR, 0);
+	setMove(START, C_LBRACE, INCOMMENT, FALSE, ERROR, 0);
+	setMove(START, C_QUOTE, INSTR, FALSE, ERROR, 0);
+	setMove(START, C_LT, INLE, TRUE, ERROR, 0);
+	setMove(START, C_GT, INGE, TRUE, ERROR, 0);
+	setMove(START, C_EOF, DONE, FALSE, ENDFILE, 0);
+	for (i = 0; i < sizeof(symbols) / sizeof(symbols[0]); i++) {
+		charClass[(unsigned char) symbols[i].c] = symbols[i].cls;
+		setMove(START, symbols[i].cls, DONE, TRUE, symbols[i].tok, 0);
+	}
+
+	setRow(INCOMMENT, INCOMMENT, FALSE, FALSE, ERROR, 0);
+	setMove(INCOMMENT, C_RBRACE, START, FALSE, ERROR, 0);
+	setMove(INCOMMENT, C_EOF, DONE, FALSE, ERROR, 2);
+
+	setRow(INSTR, INSTR, TRUE, FALSE, ERROR, 0);
+	setMove(INSTR, C_QUOTE, DONE, FALSE, STR, 0);
+	setMove(INSTR, C_NEWLINE, DONE, FALSE, ERROR, 3);
+	setMove(INSTR, C_EOF, DONE, FALSE, ERROR, 3);
+
+	setRow(INLE, DONE, FALSE, TRUE, LT, 0);
+	setMove(INLE, C_EQ, DONE, TRUE, LE, 0);
+	setRow(INGE, DONE, FALSE, TRUE, GT, 0);
+	setMove(INGE, C_EQ, DONE, TRUE, GE, 0);
+	setRow(INASSIGN, DONE, FALSE, TRUE, ERROR, 0);
+	setMove(INASSIGN, C_EQ, DONE, TRUE, ASSIGN, 0);
+
+	setRow(INNUM, DONE, FALSE, TRUE, NUM, 0);
+	setMove(INNUM, C_DIGIT, INNUM, TRUE, ERROR, 0);
+	setRow(INID, DONE, FALSE, TRUE, ID, 0);
+	setMove(INID, C_DIGIT, INID, TRUE, ERROR, 0);
+	setMove(INID, C_LETTER, INID, TRUE, ERROR, 0);
+	tablesBuilt = TRUE;
 }
 
-/****************************************/
-/* the primary function of the scanner  */
-/****************************************/
-/* function getToken returns the 
- * next token in source file
+/* function scanToken recognizes the next token
+ * by table lookup: one class lookup and one
+ * transition per character, with tight loops
+ * over the rest of identifier and number runs
+ */
+static TokenType scanToken(ScanState *s) {
+	TokenType currentToken = ERROR;
+	StateType state = s->resume;
+	s->resume = START;
+	if (state == INCOMMENT) skipComment(s);
+	while (state != DONE) {
+		int c = getNextChar(s);
+		const Transition *t =
+			&transTable[state][c == EOF ? C_EOF : charClass[(unsigned char) c]];
+		if (t->unget) ungetNextChar(s);
+		if (t->save) saveChar(s);
+		if (t->err) s->errortype = t->err;
+		state = (StateType) t->next;
+		currentToken = t->tok;
+		if (state == INCOMMENT)
+			skipComment(s);
+		else if (state == INSTR)
+			scanStringBody(s);
+		else if (state == START)
+			skipBlanks(s);
+		else if (state == INID) {
+			/* runs never cross a line, so they end by lineEnd */
+			char *p = s->pos;
+			while (p < s->lineEnd && (charClass[(unsigned char) *p] == C_LETTER ||
+									  charClass[(unsigned char) *p] == C_DIGIT))
+				p++;
+			saveRun(s, p);
+		} else if (state == INNUM) {
+			char *p = s->pos;
+			while (p < s->lineEnd && charClass[(unsigned char) *p] == C_DIGIT)
+				p++;
+			saveRun(s, p);
+		}
+	}
+	if (currentToken == ID)
+		currentToken = reservedLookup(s->lexemeStart, s->lexemeLen);
+	return currentToken;
+} /* end scanToken */
+
+#else
+
+/* function scanToken recognizes the next token
+ * by running the scanner DFA one character at a
+ * time, switching on the current state
  */
-TokenType getToken(void) { /* index for storing into tokenString */
-	int tokenStringIndex = 0;
+static TokenType scanToken(ScanState *s) {
 	/* holds current token to be returned */
-	TokenType currentToken;
-	/* current state - always begins at START */
-	StateType state = START;
-	/* flag to indicate save to tokenString */
+	TokenType currentToken = ERROR;
+	/* current state - begins at START unless the scan
+	   resumes inside a comment */
+	StateType state = s->resume;
+	/* flag to indicate save to the lexeme */
 	int save;
+	s->resume = START;
+	if (state == INCOMMENT) skipComment(s);
 	while (state != DONE) {
-		char c = getNextChar();
+		char c = getNextChar(s);
 		save = TRUE;
 		switch (state) {
 			case START:
@@ -103,14 +501,17 @@ TokenType getToken(void) { /* index for storing into tokenString */
 					state = INID;
 				else if (c == ':')
 					state = INASSIGN;
-				else if ((c == ' ') || (c == '\t') || (c == '\n'))
+				else if ((c == ' ') || (c == '\t') || (c == '\n')) {
 					save = FALSE;
-				else if (c == '{') {
+					skipBlanks(s);
+				} else if (c == '{') {
 					save = FALSE;
 					state = INCOMMENT;
+					skipComment(s);
 				} else if (c == '\'') {
 					save = FALSE;
 					state = INSTR;
+					scanStringBody(s);
 				} else if (c == '<')
 					state = INLE;
 				else if (c == '>')
@@ -151,7 +552,7 @@ TokenType getToken(void) { /* index for storing into tokenString */
 							break;
 						default:
 							currentToken = ERROR;
-							errortype = 1;
+							s->errortype = 1;
 							break;
 					}
 				}
@@ -161,7 +562,7 @@ TokenType getToken(void) { /* index for storing into tokenString */
 				if (c == EOF) {
 					state = DONE;
 					currentToken = ERROR;
-					errortype = 2;
+					s->errortype = 2;
 				} else if (c == '}')
 					state = START;
 				break;
@@ -174,7 +575,7 @@ TokenType getToken(void) { /* index for storing into tokenString */
 				} else if (c == '\n' || c == EOF) {
 					save = FALSE;
 					currentToken = ERROR;
-					errortype = 3;
+					s->errortype = 3;
 					state = DONE;
 				}
 				break;
@@ -183,7 +584,7 @@ TokenType getToken(void) { /* index for storing into tokenString */
 				if (c == '=')
 					currentToken = LE;
 				else {
-					ungetNextChar();
+					ungetNextChar(s);
 					save = FALSE;
 					currentToken = LT;
 				}
@@ -193,7 +594,7 @@ TokenType getToken(void) { /* index for storing into tokenString */
 				if (c == '=')
 					currentToken = GE;
 				else {
-					ungetNextChar();
+					ungetNextChar(s);
 					save = FALSE;
 					currentToken = GT;
 				}
@@ -203,14 +604,14 @@ TokenType getToken(void) { /* index for storing into tokenString */
 				if (c == '=')
 					currentToken = ASSIGN;
 				else { /* backup in the input */
-					ungetNextChar();
+					ungetNextChar(s);
 					save = FALSE;
 					currentToken = ERROR;
 				}
 				break;
 			case INNUM:
 				if (!isdigit(c)) { /* backup in the input */
-					ungetNextChar();
+					ungetNextChar(s);
 					save = FALSE;
 					state = DONE;
 					currentToken = NUM;
@@ -218,7 +619,7 @@ TokenType getToken(void) { /* index for storing into tokenString */
 				break;
 			case INID:
 				if (!isalpha(c) && !isdigit(c)) { /* backup in the input */
-					ungetNextChar();
+					ungetNextChar(s);
 					save = FALSE;
 					state = DONE;
 					currentToken = ID;
@@ -229,21 +630,506 @@ TokenType getToken(void) { /* index for storing into tokenString */
 				fprintf(listing, "Scanner Bug: state= %d\n", state);
 				state = DONE;
 				currentToken = ERROR;
-				errortype = 4;
+				s->errortype = 4;
 				break;
 		}
-		if ((save) && (tokenStringIndex <= MAXTOKENLEN))
-			tokenString[tokenStringIndex++] = (char) c;
-		if (state == DONE) {
-			tokenString[tokenStringIndex] = '\0';
-			if (currentToken == ID)
-				currentToken = reservedLookup(tokenString);
-		}
+		if (save) saveChar(s);
+		if (state == DONE && currentToken == ID)
+			currentToken = reservedLookup(s->lexemeStart, s->lexemeLen);
 	}
+	return currentToken;
+} /* end scanToken */
+
+#endif
+
+/* startScan sets s up to scan [begin, end) with
+   lines numbered from 1 at begin */
+static void startScan(ScanState *s, char *begin, char *end) {
+	s->pos = s->lineEnd = begin;
+	s->end = end;
+	s->eof = FALSE;
+	s->lineno = 0;
+	s->lineBase = (begin != NULL && nlines) ? lineIndex((int) (begin - srcBuf), 0) - 1 : -1;
+	s->echo = FALSE;
+	s->errortype = 0;
+	s->resume = START;
+	s->lexemeStart = begin;
+	s->lexemeLen = 0;
+}
+
+/* startMainScan loads the source and sets up the
+   scan behind getToken */
+static void startMainScan(void) {
+	if (loadSource() && buildLineIndex())
+		startScan(&mainScan, srcBuf, srcBuf + srcLen);
+	else
+		startScan(&mainScan, NULL, NULL);
+	mainScan.lineBase -= lineno;
+	mainScan.lineno = lineno;
+	mainScan.echo = EchoSource;
+#if TABLE_SCAN
+	if (!tablesBuilt) buildTables();
+#endif
+	mainScanReady = TRUE;
+}
+
+const char *sourceText(size_t *len) {
+	if (!mainScanReady) startMainScan();
+	/* close the gap an edit left */
+	if (srcGap < srcLen) moveGap(srcLen);
+	*len = srcLen;
+	return srcBuf;
+}
+
+/****************************************/
+/* the primary function of the scanner  */
+/****************************************/
+/* function getToken returns the 
+ * next token in source file
+ */
+TokenType getToken(void) {
+	TokenType currentToken;
+	if (!mainScanReady) startMainScan();
+	mainScan.lexemeLen = 0;
+	currentToken = scanToken(&mainScan);
+	if (mainScan.lexemeLen == 0) mainScan.lexemeStart = mainScan.pos;
+	lineno = mainScan.lineno;
+	errortype = mainScan.errortype;
+	tokenString = mainScan.lexemeStart;
+	tokenLength = mainScan.lexemeLen;
+	tokenpos = (int) (mainScan.lexemeStart - srcBuf);
+	if (currentToken == ID)
+		tokenSym = internName(tokenString, tokenLength, nameHash(tokenString, tokenLength));
 	if (TraceScan && currentToken != ENDFILE) {
 		fprintf(listing, "\t%d: ", lineno);
-		printToken(currentToken, tokenString);
+		printToken(currentToken, tokenString, tokenLength);
 	}
-
 	return currentToken;
-} /* end getToken */
\ No newline at end of file
+} /* end getToken */
+
+/* appendToken adds the token just scanned by s to
+   ts with the given sym; it returns FALSE if out of
+   memory */
+static int appendToken(TokenStream *ts, TokenType tok, ScanState *s, SymId sym) {
+	if (ts->count == ts->size) {
+		int n = ts->size ? 2 * ts->size : 1024;
+		unsigned char *kind = (unsigned char *) realloc(ts->kind, n);
+		unsigned char *err = (unsigned char *) realloc(ts->err, n);
+		int *offset = (int *) realloc(ts->offset, n * sizeof(int));
+		int *length = (int *) realloc(ts->length, n * sizeof(int));
+		int *line = (int *) realloc(ts->line, n * sizeof(int));
+		SymId *syms = (SymId *) realloc(ts->sym, n * sizeof(SymId));
+		if (kind) ts->kind = kind;
+		if (err) ts->err = err;
+		if (offset) ts->offset = offset;
+		if (length) ts->length = length;
+		if (line) ts->line = line;
+		if (syms) ts->sym = syms;
+		if (!kind || !err || !offset || !length || !line || !syms) return FALSE;
+		ts->size = n;
+	}
+	ts->kind[ts->count] = (unsigned char) tok;
+	ts->err[ts->count] = (unsigned char) (tok == ERROR ? s->errortype : 0);
+	ts->offset[ts->count] = (int) (s->lexemeStart - srcBuf);
+	ts->length[ts->count] = s->lexemeLen;
+	ts->line[ts->count] = s->lineno;
+	ts->sym[ts->count] = sym;
+	ts->count++;
+	return TRUE;
+}
+
+/* listStream writes the source echo and token trace
+   that scanning ts token by token would have written;
+   it leaves errortype at the last error in ts */
+static void listStream(const TokenStream *ts) {
+	char *line = srcBuf, *end = srcBuf + srcLen;
+	int n = lineno, i;
+	for (i = 0; i < ts->count; i++) {
+		if (ts->kind[i] == ERROR) errortype = ts->err[i];
+		while (EchoSource && n < ts->line[i] && line < end) {
+			char *e = (char *) memchr(line, '\n', end - line);
+			e = (e == NULL) ? end : e + 1;
+			fprintf(listing, "%4d: ", ++n);
+			fwrite(line, 1, e - line, listing);
+			line = e;
+		}
+		if (TraceScan && ts->kind[i] != ENDFILE) {
+			fprintf(listing, "\t%d: ", ts->line[i]);
+			printToken((TokenType) ts->kind[i], ts->text + ts->offset[i], ts->length[i]);
+		}
+	}
+}
+
+/* Function scanAll tokenizes the rest of the source
+ * file into a new TokenStream, ending with ENDFILE
+ */
+TokenStream *scanAll(void) {
+	TokenStream *ts;
+	TokenType tok;
+	if (!mainScanReady) startMainScan();
+	if (LexThreads > 1 && mainScan.pos == srcBuf && mainScan.lineno == 0) {
+		ts = scanParallel(srcBuf, srcLen, LexThreads, errortype);
+		if (ts != NULL) {
+			internStream(ts);
+			listStream(ts);
+			/* leave the main scan at the end of the file */
+			mainScan.pos = mainScan.lineEnd = mainScan.end;
+			mainScan.eof = TRUE;
+			lineno = mainScan.lineno = ts->line[ts->count - 1];
+			mainScan.errortype = errortype;
+			ts->gap = ts->count;
+			return ts;
+		}
+	}
+	ts = (TokenStream *) calloc(1, sizeof(TokenStream));
+	if (ts == NULL) {
+		fprintf(listing, "Out of memory error at line %d\n", lineno);
+		return NULL;
+	}
+	ts->text = srcBuf;
+	do {
+		tok = getToken();
+		if (!appendToken(ts, tok, &mainScan, tok == ID ? tokenSym : NOSYM)) {
+			fprintf(listing, "Out of memory error at line %d\n", lineno);
+			freeTokenStream(ts);
+			return NULL;
+		}
+	} while (tok != ENDFILE);
+	ts->gap = ts->count;
+	return ts;
+}
+
+/* Function scanChunk tokenizes the stretch [begin, end)
+ * of the source buffer on its own into ts, numbering
+ * lines from 1 at begin. It starts inside a comment if
+ * inComment is set. Unless the stretch is the last one
+ * (last set), the ENDFILE token at its end is left out,
+ * and so is the error for a comment still open there.
+ * The number of lines in the stretch is stored in
+ * *lines; scanChunk returns TRUE if the stretch ends
+ * inside a comment and -1 if out of memory.
+ */
+int scanChunk(const char *begin, const char *end, int inComment, int last,
+	TokenStream *ts, int *lines) {
+	ScanState s;
+	TokenType tok;
+	startScan(&s, (char *) begin, (char *) end);
+	if (inComment) s.resume = INCOMMENT;
+	ts->text = srcBuf;
+	for (;;) {
+		s.lexemeLen = 0;
+		s.errortype = 0;
+		tok = scanToken(&s);
+		if (s.lexemeLen == 0) s.lexemeStart = s.pos;
+		if (s.eof && !last) break;
+		if (!appendToken(ts, tok, &s, tok == ID ? nameHash(s.lexemeStart, s.lexemeLen) : 0))
+			return -1;
+		if (tok == ENDFILE) break;
+	}
+	*lines = s.lineno - 1;
+	return s.eof && tok == ERROR;
+}
+
+void freeTokenStream(TokenStream *ts) {
+	if (ts == NULL) return;
+	free(ts->kind);
+	free(ts->err);
+	free(ts->offset);
+	free(ts->length);
+	free(ts->line);
+	free(ts->sym);
+	free(ts);
+}
+
+/* Procedure internStream interns the ID tokens of a
+ * stream built by scanChunk, replacing the hash in
+ * sym by the symbol id
+ */
+void internStream(TokenStream *ts) {
+	int i;
+	for (i = 0; i < ts->count; i++)
+		if (ts->kind[i] == ID)
+			ts->sym[i] = internName(ts->text + ts->offset[i], ts->length[i], ts->sym[i]);
+}
+
+/* tokenStart and tokenEnd are the source offsets
+   at which token i of ts starts and just past it;
+   the text of a STR leaves out its quotes */
+#define tokenStart(ts, i) sourceOffset(tokenPos(ts, i))
+#define tokenEnd(ts, i) \
+	(tokenStart(ts, i) + (ts)->length[tokenIndex(ts, i)] + (tokenKind(ts, i) == STR))
+
+/* firstEnding returns the first token of ts that
+   ends at pos or later, firstStarting the first that
+   starts there or later; the final ENDFILE, empty at
+   the end of the source, bounds both searches */
+static int firstEnding(const TokenStream *ts, int pos) {
+	int lo = 0, hi = ts->count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (tokenEnd(ts, mid) >= pos)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+static int firstStarting(const TokenStream *ts, int pos) {
+	int lo = 0, hi = ts->count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (tokenStart(ts, mid) >= pos)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+/* ownSource makes srcBuf a malloc'd buffer that
+   holds at least n bytes, copying the text out of
+   the mapping the first time; FALSE if out of memory */
+static int ownSource(size_t n) {
+	size_t cap, tail = srcLen - srcGap;
+	char *p;
+	if (srcMapLen == 0 && srcBuf != NULL && n <= srcCap) return TRUE;
+	cap = n + n / 2 + READCHUNK;
+	if (srcMapLen == 0)
+		p = (char *) realloc(srcBuf, cap);
+	else if ((p = (char *) malloc(cap)) != NULL) {
+		memcpy(p, srcBuf, srcLen);
+#ifdef HAVE_MMAP
+		munmap(srcBuf, srcMapLen);
+#endif
+		srcMapLen = 0;
+		srcCap = srcLen;
+	}
+	if (p == NULL) return FALSE;
+	/* the text after the gap stays at the end */
+	memmove(p + cap - tail, p + srcCap - tail, tail);
+	srcBuf = p;
+	srcCap = cap;
+	return TRUE;
+}
+
+/* growLines makes room for n more lines in the
+   newline index, keeping those after the gap at the
+   end; FALSE if out of memory */
+static int growLines(int n) {
+	int cap, tail = nlines - lineGap, *p;
+	if (nlines + n <= lineCap) return TRUE;
+	cap = 2 * (nlines + n);
+	p = (int *) realloc(lineStart, cap * sizeof(int));
+	if (p == NULL) return FALSE;
+	memmove(p + cap - tail, p + lineCap - tail, tail * sizeof(int));
+	lineStart = p;
+	lineCap = cap;
+	return TRUE;
+}
+
+/* moveLineGap moves the gap in the newline index to
+   line to, keeping the lines after it from the end */
+static void moveLineGap(int to) {
+	int skip = lineCap - nlines;
+	for (; lineGap > to; lineGap--) lineStart[lineGap - 1 + skip] = endPos(lineStart[lineGap - 1]);
+	for (; lineGap < to; lineGap++) lineStart[lineGap] = sourceOffset(lineStart[lineGap + skip]);
+}
+
+/* growStream makes room for n tokens in ts, keeping
+   those after the gap at the end */
+static int growStream(TokenStream *ts, int n) {
+	unsigned char *kind, *err;
+	int *offset, *length, *line, tail = ts->count - ts->gap, from, to;
+	SymId *syms;
+	if (n <= ts->size) return TRUE;
+	n = 2 * n;
+	kind = (unsigned char *) realloc(ts->kind, n);
+	if (kind) ts->kind = kind;
+	err = (unsigned char *) realloc(ts->err, n);
+	if (err) ts->err = err;
+	offset = (int *) realloc(ts->offset, n * sizeof(int));
+	if (offset) ts->offset = offset;
+	length = (int *) realloc(ts->length, n * sizeof(int));
+	if (length) ts->length = length;
+	line = (int *) realloc(ts->line, n * sizeof(int));
+	if (line) ts->line = line;
+	syms = (SymId *) realloc(ts->sym, n * sizeof(SymId));
+	if (syms) ts->sym = syms;
+	if (!kind || !err || !offset || !length || !line || !syms) return FALSE;
+	from = ts->gap + ts->skip;
+	to = n - tail;
+	memmove(ts->kind + to, ts->kind + from, tail);
+	memmove(ts->err + to, ts->err + from, tail);
+	memmove(ts->offset + to, ts->offset + from, tail * sizeof(int));
+	memmove(ts->length + to, ts->length + from, tail * sizeof(int));
+	memmove(ts->line + to, ts->line + from, tail * sizeof(int));
+	memmove(ts->sym + to, ts->sym + from, tail * sizeof(SymId));
+	ts->size = n;
+	ts->skip = n - ts->count;
+	return TRUE;
+}
+
+/* moveTokenGap moves the gap of ts to token to,
+   keeping the offsets and lines of the tokens after
+   it from the end */
+static void moveTokenGap(TokenStream *ts, int to) {
+	int i, j;
+	for (; ts->gap > to; ts->gap--) {
+		i = ts->gap - 1;
+		j = i + ts->skip;
+		ts->kind[j] = ts->kind[i];
+		ts->err[j] = ts->err[i];
+		ts->offset[j] = endPos(ts->offset[i]);
+		ts->length[j] = ts->length[i];
+		ts->line[j] = ts->line[i] - nlines - 2;
+		ts->sym[j] = ts->sym[i];
+	}
+	for (; ts->gap < to; ts->gap++) {
+		i = ts->gap;
+		j = i + ts->skip;
+		ts->kind[i] = ts->kind[j];
+		ts->err[i] = ts->err[j];
+		ts->offset[i] = sourceOffset(ts->offset[j]);
+		ts->length[i] = ts->length[j];
+		ts->line[i] = ts->line[j] + nlines + 2;
+		ts->sym[i] = ts->sym[j];
+	}
+}
+
+void closeGap(TokenStream *ts) {
+	moveTokenGap(ts, ts->count);
+	if (srcBuf != NULL) moveGap(srcLen);
+}
+
+/* freeChunk frees the arrays of a stream on the stack */
+static void freeChunk(TokenStream *c) {
+	free(c->kind);
+	free(c->err);
+	free(c->offset);
+	free(c->length);
+	free(c->line);
+	free(c->sym);
+	memset(c, 0, sizeof(TokenStream));
+}
+
+/* Function relexEdit makes the edit in the source and
+ * brings ts up to date. Scanning again starts where
+ * the last token ending before the line of the edit
+ * ends, which is never inside a comment, and stops at
+ * the first token on a line after the edit; no token
+ * crosses a line, so scanning from there would give
+ * the old tokens again. The gaps are first moved to
+ * where scanning stops, so that the edit and the
+ * scan are made in the text before them.
+ */
+int relexEdit(TokenStream *ts, int start, int oldLen, const char *text, int newLen,
+	TokenEdit *e) {
+	int delta = newLen - oldLen, oldEnd = start + oldLen;
+	int a, b, k, k0, k1, last, r, m, lines, removed, i, runOn = FALSE;
+	char *old;
+	TokenStream chunk;
+	if (srcBuf == NULL || start < 0 || oldLen < 0 || newLen < 0 || (size_t) oldEnd > srcLen)
+		return FALSE;
+	k0 = lineIndex(start, 0) + 1;
+	k1 = lineIndex(oldEnd, 0) + 1;
+	a = firstEnding(ts, lineAt(k0 - 1));
+	b = (k1 < nlines) ? firstStarting(ts, lineAt(k1)) : ts->count - 1;
+	/* an empty error, for a string a newline ends or a
+	   comment the end of file does, is put after the
+	   text it is about */
+	while (b < ts->count - 1 && tokenKind(ts, b) == ERROR && ts->length[tokenIndex(ts, b)] == 0)
+		b++;
+	e->first = a;
+	e->begin = a > 0 ? tokenEnd(ts, a - 1) : 0;
+	last = b == ts->count - 1;
+	e->oldEnd = last ? (int) srcLen : tokenStart(ts, b);
+	for (i = 0, m = 0; i < newLen; i++) m += text[i] == '\n';
+	if (!ownSource(srcLen + (delta > 0 ? delta : 0)) || !growLines(m - (k1 - k0))) return FALSE;
+	/* the gaps go to the end of the region */
+	if (ts->gap == ts->count) ts->skip = ts->size - ts->count;
+	moveTokenGap(ts, b + last);
+	moveGap((size_t) e->oldEnd);
+	moveLineGap(k1);
+	/* the old text of the region, to compare tokens */
+	old = (char *) malloc(e->oldEnd - e->begin + 1);
+	if (old == NULL) return FALSE;
+	memcpy(old, srcBuf + e->begin, e->oldEnd - e->begin);
+	memmove(srcBuf + start + newLen, srcBuf + oldEnd, e->oldEnd - oldEnd);
+	memcpy(srcBuf + start, text, newLen);
+	srcLen += delta;
+	srcGap += delta;
+	/* the lines starting in (start, oldEnd] go, and
+	   those the new text starts come in */
+	for (i = 0, lineGap = k0; i < newLen; i++)
+		if (text[i] == '\n') lineStart[lineGap++] = start + i + 1;
+	nlines += m - (k1 - k0);
+	ts->lines = nlines;
+	ts->text = srcBuf;
+	/* the main scan is long over; keep it past the end */
+	mainScan.pos = mainScan.lineEnd = mainScan.end = srcBuf + srcLen;
+	memset(&chunk, 0, sizeof chunk);
+	e->newEnd = last ? (int) srcLen : e->oldEnd + delta;
+	r = scanChunk(srcBuf + e->begin, srcBuf + e->newEnd, FALSE, last, &chunk, &lines);
+	if (r == TRUE && !last) {
+		/* a comment opened in the region runs on */
+		freeChunk(&chunk);
+		runOn = TRUE;
+		b = ts->count - 1;
+		last = TRUE;
+		moveGap(srcLen);
+		e->oldEnd = (int) srcLen - delta;
+		e->newEnd = (int) srcLen;
+		r = scanChunk(srcBuf + e->begin, srcBuf + e->newEnd, FALSE, TRUE, &chunk, &lines);
+	}
+	removed = b - a + last;
+	if (r < 0 || !growStream(ts, ts->count - removed + chunk.count)) {
+		free(old);
+		freeChunk(&chunk);
+		return FALSE;
+	}
+	internStream(&chunk);
+	k = lineIndex(e->begin, 0);
+	for (i = 0; i < chunk.count; i++) chunk.line[i] += k;
+	e->removed = removed;
+	e->added = chunk.count;
+	e->same = !runOn && removed == chunk.count;
+	for (i = 0; i < chunk.count && e->same; i++)
+		e->same = ts->kind[a + i] == chunk.kind[i] && ts->err[a + i] == chunk.err[i] &&
+				  ts->length[a + i] == chunk.length[i] && ts->sym[a + i] == chunk.sym[i] &&
+				  memcmp(old + (ts->offset[a + i] - e->begin), srcBuf + chunk.offset[i],
+					  chunk.length[i]) == 0;
+	free(old);
+	/* the old tokens, those before the gap from a on
+	   and, if a comment ran on, those after it, give
+	   way to the new, which go before the gap */
+	if (chunk.count > 0) {
+		memcpy(ts->kind + a, chunk.kind, chunk.count);
+		memcpy(ts->err + a, chunk.err, chunk.count);
+		memcpy(ts->offset + a, chunk.offset, chunk.count * sizeof(int));
+		memcpy(ts->length + a, chunk.length, chunk.count * sizeof(int));
+		memcpy(ts->line + a, chunk.line, chunk.count * sizeof(int));
+		memcpy(ts->sym + a, chunk.sym, chunk.count * sizeof(SymId));
+	}
+	ts->count += chunk.count - removed;
+	ts->gap = a + chunk.count;
+	ts->skip = ts->size - ts->count;
+	freeChunk(&chunk);
+	return TRUE;
+}
+
+/* Function cursorPeek returns the token k places
+ * after the current one (ENDFILE past the end)
+ */
+TokenType cursorPeek(const TokenCursor *c, int k) {
+	int i = c->pos + k;
+	if (i >= c->ts->count) i = c->ts->count - 1;
+	return tokenKind(c->ts, i);
+}
+
+/* Procedure cursorAdvance moves to the next token;
+ * the cursor stays on the final ENDFILE
+ */
+void cursorAdvance(TokenCursor *c) {
+	if (c->pos < c->ts->count - 1) c->pos++;
+}
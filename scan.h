@@ -8,15 +8,190 @@
 #ifndef _SCAN_H_
 #define _SCAN_H_
 
-/* MAXTOKENLEN is the maximum size of a token */
-#define MAXTOKENLEN 256
+/* tokenString and tokenLength give the lexeme of
+ * the last token as a view into the source buffer;
+ * it is not NUL-terminated and stays valid for the
+ * rest of the compilation
+ */
+extern const char *tokenString;
+extern int tokenLength;
+
+/* tokenSym holds the interned id of the last ID
+ * token returned by getToken
+ */
+extern SymId tokenSym;
+
+/* A position in the source is kept as its byte
+ * offset, but for those an edit session keeps from
+ * the end (see relexEdit): a negative pos stands for
+ * the offset -pos - 1 bytes before the end, so that
+ * an edit before it leaves it as it is. Function
+ * sourceOffset returns the offset pos stands for,
+ * and endPos the position from the end for offset.
+ */
+int sourceOffset(int pos);
+int endPos(int offset);
 
-/* tokenString array stores the lexeme of each token */
-extern char tokenString[MAXTOKENLEN + 1];
+/* Function sourceLine returns the number of the line
+ * holding the position pos of the source, and
+ * sourceColumn its column, both counted from 1; they
+ * search an index of the newlines built when the
+ * source is loaded
+ */
+int sourceLine(int pos);
+int sourceColumn(int pos);
+
+/* Function sourceAt returns the text at position
+ * pos, which lies after the gap an edit leaves in
+ * the source buffer if pos is kept from the end
+ */
+const char *sourceAt(int pos);
+
+/* Function sourceText returns the whole source text,
+ * loading it if need be, and stores its length in
+ * *len; NULL if the scanner cannot give it. Scanning
+ * still starts from the beginning of the text.
+ */
+const char *sourceText(size_t *len);
 
 /* function getToken returns the 
  * next token in source file
  */
 TokenType getToken(void);
 
+/* TokenStream holds the tokens of a whole source
+ * file as parallel arrays; the last token is ENDFILE.
+ * Token i is at index i of the arrays before gap and
+ * at i + skip from there on; relexEdit leaves a gap
+ * there, and keeps the offsets and lines of the
+ * tokens after it from the end. skip is 0 otherwise.
+ */
+typedef struct {
+	int count;			 /* number of tokens */
+	int size;			 /* allocated length of the arrays */
+	int gap, skip;		 /* where the gap is, and its length */
+	int lines;			 /* lines of the source, when skip is set */
+	const char *text;	 /* source buffer the offsets refer to */
+	unsigned char *kind; /* TokenType of each token */
+	unsigned char *err;	 /* errortype of each ERROR token */
+	int *offset;		 /* position of each lexeme in text */
+	int *length;		 /* full length of each lexeme */
+	int *line;			 /* source line of each token */
+	SymId *sym;			 /* interned id of each ID token */
+} TokenStream;
+
+/* tokenIndex is the index of token i in the arrays
+ * of ts; tokenKind and tokenPos give its kind and
+ * position, and tokenLine its line, which a token
+ * after the gap keeps as line - lines - 2
+ */
+#define tokenIndex(ts, i) ((i) < (ts)->gap ? (i) : (i) + (ts)->skip)
+#define tokenKind(ts, i) ((TokenType) (ts)->kind[tokenIndex(ts, i)])
+#define tokenPos(ts, i) ((ts)->offset[tokenIndex(ts, i)])
+#define tokenLine(ts, i) \
+	((ts)->line[tokenIndex(ts, i)] >= 0 ? (ts)->line[tokenIndex(ts, i)] \
+										 : (ts)->line[tokenIndex(ts, i)] + (ts)->lines + 2)
+
+/* Function scanAll tokenizes the rest of the source
+ * file into a new TokenStream
+ */
+TokenStream *scanAll(void);
+
+void freeTokenStream(TokenStream *ts);
+
+/* Procedure internStream interns the ID tokens of a
+ * stream built by scanChunk, replacing the hash in
+ * sym by the symbol id
+ */
+void internStream(TokenStream *ts);
+
+/* Function scanChunk tokenizes the stretch [begin, end)
+ * of the source buffer on its own into ts, numbering
+ * lines from 1 at begin. It starts inside a comment if
+ * inComment is set. Unless the stretch is the last one
+ * (last set), the ENDFILE token at its end is left out,
+ * and so is the error for a comment still open there.
+ * The number of lines in the stretch is stored in
+ * *lines. ID tokens carry the nameHash of their text
+ * in sym until internStream turns it into an id, so
+ * chunks on several threads never touch the intern
+ * table. scanChunk returns TRUE if the stretch ends
+ * inside a comment and -1 if out of memory.
+ */
+int scanChunk(const char *begin, const char *end, int inComment, int last,
+	TokenStream *ts, int *lines);
+
+/* TokenEdit tells how relexEdit changed a stream:
+ * the tokens [first, first + removed) gave way to
+ * [first, first + added), which were scanned from the
+ * bytes [begin, newEnd) of the edited source, in place
+ * of [begin, oldEnd) before; same is TRUE if the new
+ * tokens read just as the old ones did
+ */
+typedef struct {
+	int first, removed, added;
+	int begin, oldEnd, newEnd;
+	int same;
+} TokenEdit;
+
+/* Function relexEdit replaces the bytes [start, start
+ * + oldLen) of the source by the newLen bytes at text,
+ * keeping the newline index in step, and brings ts, a
+ * stream of the whole source from scanAll, up to date
+ * by scanning again only the lines about the edit,
+ * unless a comment opened there runs on. It describes
+ * the change in *e and returns FALSE if the range is
+ * outside the source or memory runs out.
+ * The source buffer, the newline index and ts are
+ * left with a gap after the tokens scanned again,
+ * where the next edit moves it, so an edit takes
+ * time for the text between it and the last one
+ * rather than for the whole source; the positions
+ * after the gap are kept from the end.
+ */
+int relexEdit(TokenStream *ts, int start, int oldLen, const char *text, int newLen,
+	TokenEdit *e);
+
+/* Procedure closeGap moves the gap relexEdit left in
+ * ts, and in the source buffer, to the end, so that
+ * every token is at its index and has its offset
+ */
+void closeGap(TokenStream *ts);
+
+/* TokenCursor is the parser's position in a TokenStream */
+typedef struct {
+	const TokenStream *ts;
+	int pos;
+} TokenCursor;
+
+/* cursorToken and cursorLine give the current token
+ * and its source line
+ */
+#define cursorToken(c) tokenKind((c)->ts, (c)->pos)
+#define cursorLine(c) tokenLine((c)->ts, (c)->pos)
+
+/* cursorText and cursorLength give the lexeme of
+ * the current token as a view into the source, and
+ * cursorOffset its position
+ */
+#define cursorText(c) \
+	(cursorOffset(c) >= 0 ? (c)->ts->text + cursorOffset(c) : sourceAt(cursorOffset(c)))
+#define cursorLength(c) ((c)->ts->length[tokenIndex((c)->ts, (c)->pos)])
+#define cursorOffset(c) tokenPos((c)->ts, (c)->pos)
+
+/* cursorSym gives the interned id of the current
+ * token, NOSYM unless it is an ID
+ */
+#define cursorSym(c) ((c)->ts->sym[tokenIndex((c)->ts, (c)->pos)])
+
+/* Function cursorPeek returns the token k places
+ * after the current one (ENDFILE past the end)
+ */
+TokenType cursorPeek(const TokenCursor *c, int k);
+
+/* Procedure cursorAdvance moves to the next token;
+ * the cursor stays on the final ENDFILE
+ */
+void cursorAdvance(TokenCursor *c);
+
 #endif
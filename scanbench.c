@@ -0,0 +1,65 @@
+/****************************************************/
+/* File: scanbench.c                                */
+/* Scanner throughput benchmark for the TINY        */
+/* compiler: times getToken over one source file    */
+/* with all listing output off. It is linked with   */
+/* scan.c (scanbench.exe) or with the lex/tiny.l    */
+/* scanner (scanbench-flex.exe); see the makefile   */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "scan.h"
+#include <time.h>
+
+/* the globals main.c would allocate */
+THREAD_LOCAL int lineno = 0;
+THREAD_LOCAL int tokenpos = 0;
+FILE *source;
+FILE *listing;
+FILE *code;
+
+int EchoSource = FALSE;
+int TraceScan = FALSE;
+int TraceParse = FALSE;
+int TraceAnalyze = FALSE;
+int TraceCode = FALSE;
+
+int ScanWholeFile = FALSE;
+int LexThreads = 1;
+int ParseThreads = 1;
+int ShareExps = FALSE;
+
+int Error = FALSE;
+
+int main(int argc, char *argv[]) {
+	long bytes, tokens = 0, errors = 0;
+	clock_t start;
+	double secs;
+	TokenType tok;
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <filename>\n", argv[0]);
+		return 1;
+	}
+	source = fopen(argv[1], "r");
+	if (source == NULL) {
+		fprintf(stderr, "File %s not found\n", argv[1]);
+		return 1;
+	}
+	listing = stdout;
+	fseek(source, 0, SEEK_END);
+	bytes = ftell(source);
+	rewind(source);
+	start = clock();
+	while ((tok = getToken()) != ENDFILE) {
+		tokens++;
+		if (tok == ERROR) errors++;
+	}
+	secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+	printf("%s: %ld bytes, %ld tokens (%ld errors), %ld lines, %.3f s, %.1f MB/s\n",
+		argv[1], bytes, tokens, errors, (long) sourceLine((int) bytes), secs,
+		secs > 0 ? bytes / secs / 1e6 : 0.0);
+	fclose(source);
+	return 0;
+}
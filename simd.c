@@ -0,0 +1,230 @@
+/****************************************************/
+/* File: simd.c                                     */
+/* SIMD scanning kernels for the TINY scanner       */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* isRunEnd tells whether c ends a run of the given kind */
+static int isRunEnd(RunKind kind, char c) {
+	switch (kind) {
+		case RUN_BLANKS:
+			return c != ' ' && c != '\t' && c != '\n';
+		case RUN_COMMENT:
+			return c == '}';
+		default:
+			return c == '\'' || c == '\n';
+	}
+}
+
+/* the scalar kernels, also used for the tails
+   the vector kernels leave over */
+static const char *runScalar(RunKind kind, const char *p, const char *end) {
+	while (p < end && !isRunEnd(kind, *p)) p++;
+	return p;
+}
+
+static long countScalar(const char *p, const char *end) {
+	long n = 0;
+	while ((p = (const char *) memchr(p, '\n', end - p)) != NULL) {
+		n++;
+		p++;
+	}
+	return n;
+}
+
+/* listScalar lists the newlines of [p, end) as
+   offsets from base */
+static void listScalar(const char *base, const char *p, const char *end, int *out) {
+	while ((p = (const char *) memchr(p, '\n', end - p)) != NULL) {
+		*out++ = (int) (p - base);
+		p++;
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+
+/* listMask stores the offsets of the bits set in mask,
+   relative to base, into out and returns the new end */
+static int *listMask(unsigned mask, int base, int *out) {
+	while (mask) {
+		*out++ = base + __builtin_ctz(mask);
+		mask &= mask - 1;
+	}
+	return out;
+}
+
+__attribute__((target("sse2"))) static const char *runSSE2(RunKind kind,
+	const char *p, const char *end) {
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i blank = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i rbrace = _mm_set1_epi8('}');
+	const __m128i quote = _mm_set1_epi8('\'');
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		unsigned stop;
+		switch (kind) {
+			case RUN_BLANKS:
+				stop = ~(unsigned) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, newline),
+							_mm_or_si128(_mm_cmpeq_epi8(v, blank), _mm_cmpeq_epi8(v, tab)))) &
+					   0xFFFFu;
+				break;
+			case RUN_COMMENT:
+				stop = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, rbrace));
+				break;
+			default:
+				stop = (unsigned) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, newline),
+					_mm_cmpeq_epi8(v, quote)));
+				break;
+		}
+		if (stop) return p + __builtin_ctz(stop);
+		p += 16;
+	}
+	return runScalar(kind, p, end);
+}
+
+__attribute__((target("sse2"))) static long countSSE2(const char *p, const char *end) {
+	const __m128i newline = _mm_set1_epi8('\n');
+	long n = 0;
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		n += __builtin_popcount((unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+		p += 16;
+	}
+	return n + countScalar(p, end);
+}
+
+__attribute__((target("sse2"))) static void listSSE2(const char *p, const char *end, int *out) {
+	const __m128i newline = _mm_set1_epi8('\n');
+	const char *base = p;
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		out = listMask((unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)),
+			(int) (p - base), out);
+		p += 16;
+	}
+	listScalar(base, p, end, out);
+}
+
+__attribute__((target("avx2"))) static const char *runAVX2(RunKind kind,
+	const char *p, const char *end) {
+	const __m256i newline = _mm256_set1_epi8('\n');
+	const __m256i blank = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i rbrace = _mm256_set1_epi8('}');
+	const __m256i quote = _mm256_set1_epi8('\'');
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) p);
+		unsigned stop;
+		switch (kind) {
+			case RUN_BLANKS:
+				stop = ~(unsigned) _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, newline),
+					_mm256_or_si256(_mm256_cmpeq_epi8(v, blank), _mm256_cmpeq_epi8(v, tab))));
+				break;
+			case RUN_COMMENT:
+				stop = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, rbrace));
+				break;
+			default:
+				stop = (unsigned) _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, newline),
+					_mm256_cmpeq_epi8(v, quote)));
+				break;
+		}
+		if (stop) return p + __builtin_ctz(stop);
+		p += 32;
+	}
+	return runScalar(kind, p, end);
+}
+
+__attribute__((target("avx2"))) static long countAVX2(const char *p, const char *end) {
+	const __m256i newline = _mm256_set1_epi8('\n');
+	long n = 0;
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) p);
+		n += __builtin_popcount((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)));
+		p += 32;
+	}
+	return n + countScalar(p, end);
+}
+
+__attribute__((target("avx2"))) static void listAVX2(const char *p, const char *end, int *out) {
+	const __m256i newline = _mm256_set1_epi8('\n');
+	const char *base = p;
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) p);
+		out = listMask((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)),
+			(int) (p - base), out);
+		p += 32;
+	}
+	listScalar(base, p, end, out);
+}
+
+#endif
+
+static void chooseKernels(void);
+
+static const char *runDispatch(RunKind kind, const char *p, const char *end) {
+	chooseKernels();
+	return skipRun(kind, p, end);
+}
+
+static long countDispatch(const char *p, const char *end) {
+	chooseKernels();
+	return countNewlines(p, end);
+}
+
+static void listDispatch(const char *p, const char *end, int *out) {
+	chooseKernels();
+	listNewlines(p, end, out);
+}
+
+static void listPlain(const char *p, const char *end, int *out) {
+	listScalar(p, p, end, out);
+}
+
+/* the kernels in use, chosen on the first call */
+static const char *(*runKernel)(RunKind, const char *, const char *) = runDispatch;
+static long (*countKernel)(const char *, const char *) = countDispatch;
+static void (*listKernel)(const char *, const char *, int *) = listDispatch;
+
+/* chooseKernels picks the widest kernels the CPU
+   supports */
+static void chooseKernels(void) {
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		runKernel = runAVX2;
+		countKernel = countAVX2;
+		listKernel = listAVX2;
+		return;
+	} else if (__builtin_cpu_supports("sse2")) {
+		runKernel = runSSE2;
+		countKernel = countSSE2;
+		listKernel = listSSE2;
+		return;
+	}
+#endif
+	runKernel = runScalar;
+	countKernel = countScalar;
+	listKernel = listPlain;
+}
+
+const char *skipRun(RunKind kind, const char *p, const char *end) {
+	return runKernel(kind, p, end);
+}
+
+long countNewlines(const char *p, const char *end) {
+	return countKernel(p, end);
+}
+
+void listNewlines(const char *p, const char *end, int *out) {
+	listKernel(p, end, out);
+}
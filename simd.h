@@ -0,0 +1,35 @@
+/****************************************************/
+/* File: simd.h                                     */
+/* SIMD scanning kernels for the TINY scanner       */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+/* kinds of character runs the kernels skip over */
+typedef enum { RUN_BLANKS, /* blanks, tabs and newlines */
+	RUN_COMMENT,		   /* comment body, up to '}' */
+	RUN_STRING } RunKind;  /* string body, up to '\'' or newline */
+
+/* Function skipRun returns the first character in
+ * [p, end) that ends a run of the given kind, or end
+ * if there is none.
+ */
+const char *skipRun(RunKind kind, const char *p, const char *end);
+
+/* Function countNewlines returns the number of
+ * newlines in [p, end)
+ */
+long countNewlines(const char *p, const char *end);
+
+/* Procedure listNewlines stores the offset from p of
+ * each newline in [p, end) into out, in order; out
+ * must have room for countNewlines(p, end) entries
+ */
+void listNewlines(const char *p, const char *end, int *out);
+
+/* The SSE2 or AVX2 kernels are chosen at run time. */
+
+#endif
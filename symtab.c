@@ -2,8 +2,7 @@
 /* File: symtab.c                                   */
 /* Symbol table implementation for the TINY compiler*/
 /* (allows only one symbol table)                   */
-/* Symbol table is implemented as a chained         */
-/* hash table                                       */
+/* Symbol table records are found by symbol id      */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
 /****************************************************/
@@ -13,16 +12,20 @@
 #include <string.h>
 #include "globals.h"
 #include "symtab.h"
+#include "intern.h"
+#include "scan.h"
 
-/* SIZE is the size of the hash table */
+/* SIZE is the number of buckets the listing of the
+   table is ordered by, as when the table was a
+   chained hash table of that many buckets */
 #define SIZE 211
 
 /* SHIFT is the power of two used as multiplier
-   in hash function  */
+   in the listing order function  */
 #define SHIFT 4
 
-/* the hash function */
-static int hash(char *key) {
+/* listBucket returns the bucket key went in */
+static int listBucket(char *key) {
 	int temp = 0;
 	int i = 0;
 	while (key[i] != '\0') {
@@ -32,125 +35,429 @@ static int hash(char *key) {
 	return temp;
 }
 
-/* the list of line numbers of the source 
- * code in which a variable is referenced
+/* CHUNK is the number of occurrences a chunk holds */
+#define CHUNK 16
+
+/* an occurrence of a variable in the source code,
+ * kept as a position (see sourceOffset) until a line
+ * number is needed, and its kind, OCC_DEF or OCC_USE
  */
-typedef struct LineListRec {
-	int lineno;
-	struct LineListRec *next;
-} * LineList;
-
-/* The record in the bucket lists for
- * each variable, including name, 
- * assigned memory location, and
- * the list of line numbers in which
- * it appears in the source code
+typedef struct {
+	int pos;
+	int kind;
+} Occurrence;
+
+/* a chunk of occurrences; those an edit adds or
+   drops move only within their chunk, which splits
+   when full and goes when empty */
+typedef struct {
+	int n; /* occurrences in use */
+	Occurrence occ[CHUNK];
+} Chunk;
+
+/* The record for each variable, including
+ * name, assigned memory location, and
+ * its occurrences in the source code, in source
+ * order in chunks, the declaration first
  */
 typedef struct BucketListRec {
 	char *name;
+	SymId sym;
 	int type;
-	LineList lines;
-	int memloc; /* memory location for variable */
-	struct BucketListRec *next;
+	Chunk **chunk; /* the chunks, nchunks of them */
+	int nchunks, chunkCap;
+	Chunk *tail; /* the last chunk, where uses go */
+	int hintChunk, hintIndex; /* the occurrence findOcc last found */
+	int memloc;	 /* memory location for variable */
+	int seq;	 /* number of variables inserted before */
 } * BucketList;
 
-/* the hash table */
-static BucketList hashTable[SIZE];
+/* the records by symbol id, so that lookups need
+   neither a hash nor a string comparison; the
+   names were hashed once, when interned */
+static BucketList *bySym = NULL;
+static int bySymSize = 0;
+
+/* the number of variables inserted */
+static int nvars = 0;
 
+/* findSym returns the record of sym or NULL */
+#define findSym(sym) ((int) (sym) < bySymSize ? bySym[sym] : NULL)
 
-void symtabError(int lineno, char *message) {
-	fprintf(listing, "Symbol Table error at line %d: %s\n", lineno, message);
+
+void symtabError(int pos, char *message) {
+	fprintf(listing, "Symbol Table error at line %d, column %d: %s\n", sourceLine(pos), sourceColumn(pos),
+		message);
 	Error = TRUE;
 }
 
-/* Procedure st_insert inserts line numbers and
- * memory locations into the symbol table
- * loc = memory location is inserted only the
- * first time, otherwise ignored
+/* addChunk puts a new, empty chunk at index c of
+   the chunks of l and returns it; NULL if out of
+   memory */
+static Chunk *addChunk(BucketList l, int c) {
+	Chunk *k;
+	if (l->nchunks == l->chunkCap) {
+		int n = l->chunkCap ? 2 * l->chunkCap : 1;
+		Chunk **t = (Chunk **) realloc(l->chunk, n * sizeof(Chunk *));
+		if (t == NULL) return NULL;
+		l->chunk = t;
+		l->chunkCap = n;
+	}
+	k = (Chunk *) malloc(sizeof(Chunk));
+	if (k == NULL) return NULL;
+	k->n = 0;
+	memmove(l->chunk + c + 1, l->chunk + c, (l->nchunks - c) * sizeof(Chunk *));
+	l->chunk[c] = k;
+	l->nchunks++;
+	l->tail = l->chunk[l->nchunks - 1];
+	return k;
+}
+
+/* dropChunk frees chunk c of l */
+static void dropChunk(BucketList l, int c) {
+	free(l->chunk[c]);
+	l->nchunks--;
+	memmove(l->chunk + c, l->chunk + c + 1, (l->nchunks - c) * sizeof(Chunk *));
+	l->tail = l->nchunks ? l->chunk[l->nchunks - 1] : NULL;
+}
+
+/* seek finds, by binary search, the first
+   occurrence of l at or after offset pos, or if
+   byLine, on or after line pos; it sets *c to its
+   chunk and *i to its index there, or *c to
+   nchunks if there is none */
+static void seek(BucketList l, int pos, int byLine, int *c, int *i) {
+	int lo = 0, hi = l->nchunks;
+	Chunk *k;
+#define below(o) ((byLine ? sourceLine((o).pos) : sourceOffset((o).pos)) < pos)
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		k = l->chunk[mid];
+		if (below(k->occ[k->n - 1]))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*c = lo;
+	*i = 0;
+	if (lo == l->nchunks) return;
+	k = l->chunk[lo];
+	for (hi = k->n - 1; *i < hi;) {
+		int mid = (*i + hi) / 2;
+		if (below(k->occ[mid]))
+			*i = mid + 1;
+		else
+			hi = mid;
+	}
+#undef below
+}
+
+/* Procedure st_insert inserts a variable with its
+ * type, the byte offset pos of its declaration and
+ * its memory location loc into the symbol table;
+ * a second declaration is reported as an error
  */
-void st_insert(char *name, int type, int lineno, int loc) {
-	int h = hash(name);
-	BucketList l = hashTable[h];
-	while ((l != NULL) && (strcmp(name, l->name) != 0))
-		l = l->next;
+void st_insert(SymId sym, int type, int pos, int loc) {
+	BucketList l = findSym(sym);
 	if (l == NULL) /* variable not yet in table */
 	{
-		l = (BucketList) malloc(sizeof(struct BucketListRec));
-		l->name = (char *) malloc(strlen(name) + 1);
-		strcpy(l->name, name);
+		if ((int) sym >= bySymSize) {
+			int n = bySymSize ? bySymSize : 256, i;
+			BucketList *t;
+			while (n <= (int) sym) n *= 2;
+			t = (BucketList *) realloc(bySym, n * sizeof(BucketList));
+			if (t == NULL) {
+				fprintf(listing, "Out of memory error at line %d\n", sourceLine(pos));
+				return;
+			}
+			for (i = bySymSize; i < n; i++) t[i] = NULL;
+			bySym = t;
+			bySymSize = n;
+		}
+		l = (BucketList) calloc(1, sizeof(struct BucketListRec));
+		if (l == NULL || addChunk(l, 0) == NULL) {
+			fprintf(listing, "Out of memory error at line %d\n", sourceLine(pos));
+			return;
+		}
+		l->name = symName(sym);
+		l->sym = sym;
 		l->type = type;
-		l->lines = (LineList) malloc(sizeof(struct LineListRec));
-		l->lines->lineno = lineno;
+		l->tail->occ[0].pos = pos;
+		l->tail->occ[0].kind = OCC_DEF;
+		l->tail->n = 1;
 		l->memloc = loc;
-		l->lines->next = NULL;
-		l->next = hashTable[h];
-		hashTable[h] = l;
+		l->seq = nvars++;
+		bySym[sym] = l;
 	} else
-		symtabError(lineno, "redeclare indentifier");
+		symtabError(pos, "redeclare indentifier");
 } /* st_insert */
 
-void st_addline(char *name, int lineno) {
-	int h = hash(name);
-	LineList t;
-	BucketList l;
-	l = hashTable[h];
-	while ((l != NULL) && (strcmp(name, l->name) != 0))
-		l = l->next;
+/* addOcc records an occurrence of the variable of
+   record l */
+static void addOcc(BucketList l, int pos, int kind) {
+	Chunk *k = l->tail;
+	int c, i, at = sourceOffset(pos);
+	/* occurrences come in source order but for those
+	   an edit adds, which go in among the others */
+	if (sourceOffset(k->occ[k->n - 1].pos) <= at) {
+		if (k->n == CHUNK) k = addChunk(l, l->nchunks);
+		i = k ? k->n : 0;
+	} else {
+		seek(l, at + 1, FALSE, &c, &i);
+		k = l->chunk[c];
+		if (k->n == CHUNK) {
+			/* split the chunk, the upper half going
+			   into a new one */
+			Chunk *h = addChunk(l, c + 1);
+			if (h != NULL) {
+				h->n = CHUNK / 2;
+				memcpy(h->occ, k->occ + CHUNK / 2, h->n * sizeof(Occurrence));
+				k->n = CHUNK / 2;
+				if (i > k->n) {
+					i -= k->n;
+					k = h;
+				}
+			} else
+				k = NULL;
+		}
+	}
+	if (k == NULL) {
+		fprintf(listing, "Out of memory error at line %d\n", sourceLine(pos));
+		return;
+	}
+	memmove(k->occ + i + 1, k->occ + i, (k->n - i) * sizeof(Occurrence));
+	k->occ[i].pos = pos;
+	k->occ[i].kind = kind;
+	k->n++;
+}
+
+void st_addline(SymId sym, int pos, int kind) {
+	addOcc(findSym(sym), pos, kind);
+}
+
+int st_resolve(SymId sym, int pos, int kind) {
+	BucketList l = findSym(sym);
+	if (l == NULL) return -1;
+	addOcc(l, pos, kind);
+	return l->type;
+}
+
+/* findOcc returns the occurrence of l at pos, other
+   than the declaration, or NULL, and sets *c and *i
+   to its chunk and index there. An edit goes over
+   the occurrences in order, so the one after that
+   found last is tried before searching. */
+static Occurrence *findOcc(BucketList l, int pos, int *c, int *i) {
+	Occurrence *o;
+	int x = sourceOffset(pos);
+	if (l == NULL) return NULL;
+	*c = l->hintChunk;
+	*i = l->hintIndex + 1;
+	if (*c < l->nchunks && *i >= l->chunk[*c]->n) {
+		++*c;
+		*i = 0;
+	}
+	if (*c >= l->nchunks || *i >= l->chunk[*c]->n || sourceOffset(l->chunk[*c]->occ[*i].pos) != x)
+		seek(l, x, FALSE, c, i);
+	if (*c == l->nchunks || (*c == 0 && *i == 0)) return NULL;
+	o = &l->chunk[*c]->occ[*i];
+	if (sourceOffset(o->pos) != x) return NULL;
+	l->hintChunk = *c;
+	l->hintIndex = *i;
+	return o;
+}
+
+void st_dropline(SymId sym, int pos) {
+	BucketList l = findSym(sym);
+	Chunk *k;
+	int c, i;
+	if (findOcc(l, pos, &c, &i) == NULL) return;
+	k = l->chunk[c];
+	memmove(k->occ + i, k->occ + i + 1, (k->n - i - 1) * sizeof(Occurrence));
+	if (--k->n == 0) dropChunk(l, c);
+	/* the next is where this one was */
+	l->hintIndex = i - 1;
+}
 
-	t = l->lines;
-	while (t->next != NULL) t = t->next;
-	t->next = (LineList) malloc(sizeof(struct LineListRec));
-	t->next->lineno = lineno;
-	t->next->next = NULL;
+void st_repos(SymId sym, int pos, int to) {
+	int c, i;
+	Occurrence *o = findOcc(findSym(sym), pos, &c, &i);
+	if (o != NULL) o->pos = to;
+}
+
+void st_clear(void) {
+	int i;
+	for (i = 1; i < bySymSize; i++)
+		if (bySym[i] != NULL) {
+			while (bySym[i]->nchunks > 0) dropChunk(bySym[i], bySym[i]->nchunks - 1);
+			free(bySym[i]->chunk);
+			free(bySym[i]);
+		}
+	free(bySym);
+	bySym = NULL;
+	bySymSize = 0;
+	nvars = 0;
+}
+
+int st_occurrences(SymId sym, int mask, int first, int last, int *pos, int max) {
+	BucketList l = findSym(sym);
+	int c, i, n = 0;
+	if (l == NULL) return 0;
+	/* sourceLine goes up with the offset, so the
+	   lines can be searched for like the offsets */
+	for (seek(l, first, TRUE, &c, &i); c < l->nchunks; c++, i = 0) {
+		Chunk *k = l->chunk[c];
+		for (; i < k->n; i++) {
+			if (sourceLine(k->occ[i].pos) > last) return n;
+			if (k->occ[i].kind & mask) {
+				if (n < max) pos[n] = sourceOffset(k->occ[i].pos);
+				n++;
+			}
+		}
+	}
+	return n;
 }
 
 /* Function st_lookup returns the memory 
  * location of a variable or -1 if not found
  */
-int st_lookup(char *name) {
-	int h = hash(name);
-	BucketList l = hashTable[h];
-	while ((l != NULL) && (strcmp(name, l->name) != 0))
-		l = l->next;
+int st_lookup(SymId sym) {
+	BucketList l = findSym(sym);
 	if (l == NULL)
 		return -1;
 	else
 		return l->memloc;
 }
 
-int st_gettype(char *name) {
-	int h = hash(name);
-	BucketList l = hashTable[h];
-	while ((l != NULL) && (strcmp(name, l->name) != 0))
-		l = l->next;
+int st_gettype(SymId sym) {
+	BucketList l = findSym(sym);
 	if (l == NULL)
 		return -1;
 	else
 		return l->type;
 }
 
+/* ListEntry places a record in the listing, by
+   bucket and, within one, latest inserted first */
+typedef struct {
+	int bucket, seq;
+	BucketList l;
+} ListEntry;
+
+static int listOrder(const void *a, const void *b) {
+	const ListEntry *p = (const ListEntry *) a, *q = (const ListEntry *) b;
+	if (p->bucket != q->bucket) return p->bucket < q->bucket ? -1 : 1;
+	return q->seq - p->seq;
+}
+
 /* Procedure printSymTab prints a formatted 
  * listing of the symbol table contents 
  * to the listing file
  */
 void printSymTab(FILE *listing) {
-	int i;
+	ListEntry *e = (ListEntry *) malloc((nvars ? nvars : 1) * sizeof(ListEntry));
+	int i, n = 0;
 	fprintf(listing, "Variable Name  Location   Line Numbers\n");
 	fprintf(listing, "-------------  --------   ------------\n");
-	for (i = 0; i < SIZE; ++i) {
-		if (hashTable[i] != NULL) {
-			BucketList l = hashTable[i];
-			while (l != NULL) {
-				LineList t = l->lines;
-				fprintf(listing, "%-14s ", l->name);
-				fprintf(listing, "%-8d  ", l->memloc);
-				while (t != NULL) {
-					fprintf(listing, "%4d ", t->lineno);
-					t = t->next;
-				}
-				fprintf(listing, "\n");
-				l = l->next;
-			}
+	if (e == NULL) {
+		fprintf(listing, "Out of memory error\n");
+		return;
+	}
+	for (i = 1; i < bySymSize; i++)
+		if (bySym[i] != NULL) {
+			e[n].bucket = listBucket(bySym[i]->name);
+			e[n].seq = bySym[i]->seq;
+			e[n++].l = bySym[i];
 		}
+	qsort(e, n, sizeof(ListEntry), listOrder);
+	for (i = 0; i < n; i++) {
+		BucketList l = e[i].l;
+		int c, k;
+		fprintf(listing, "%-14s ", l->name);
+		fprintf(listing, "%-8d  ", l->memloc);
+		for (c = 0; c < l->nchunks; c++)
+			for (k = 0; k < l->chunk[c]->n; k++)
+				fprintf(listing, "%4d ", sourceLine(l->chunk[c]->occ[k].pos));
+		fprintf(listing, "\n");
 	}
+	free(e);
 } /* printSymTab */
+
+/* printOccurrences lists the lines of the occurrences
+   of sym of the kinds in mask on lines first to last */
+static void printOccurrences(FILE *listing, SymId sym, int mask, int first, int last) {
+	int n = st_occurrences(sym, mask, first, last, NULL, 0), i;
+	int *pos = (int *) malloc((n ? n : 1) * sizeof(int));
+	if (pos == NULL) {
+		fprintf(listing, "Out of memory error\n");
+		return;
+	}
+	st_occurrences(sym, mask, first, last, pos, n);
+	fprintf(listing, "%-10s", mask == OCC_DEF ? "  defined" : "  used");
+	for (i = 0; i < n; i++) fprintf(listing, "%4d ", sourceLine(pos[i]));
+	fprintf(listing, "\n");
+	free(pos);
+}
+
+void printXref(FILE *listing, SymId sym, int first, int last) {
+	if (st_lookup(sym) == -1) {
+		fprintf(listing, "%s is not declared\n", symName(sym));
+		return;
+	}
+	if (last == INT_MAX)
+		fprintf(listing, "Cross reference of %s from line %d:\n", symName(sym), first);
+	else
+		fprintf(listing, "Cross reference of %s on lines %d to %d:\n", symName(sym), first, last);
+	printOccurrences(listing, sym, OCC_DEF, first, last);
+	printOccurrences(listing, sym, OCC_USE, first, last);
+}
+
+/* st_save writes, for each variable in order of
+   symbol id, which is the order the declarations
+   went in, the ints sym, type, memloc, the number of
+   occurrences and the occurrences as pairs of ints,
+   position and kind, declaration first */
+void st_save(FILE *f) {
+	int i, c;
+	for (i = 1; i < bySymSize; i++)
+		if (bySym[i] != NULL) {
+			BucketList l = bySym[i];
+			int rec[4];
+			rec[0] = i;
+			rec[1] = l->type;
+			rec[2] = l->memloc;
+			rec[3] = 0;
+			for (c = 0; c < l->nchunks; c++) rec[3] += l->chunk[c]->n;
+			fwrite(rec, sizeof(int), 4, f);
+			for (c = 0; c < l->nchunks; c++)
+				fwrite(l->chunk[c]->occ, sizeof(Occurrence), l->chunk[c]->n, f);
+		}
+}
+
+int st_restore(const char *p, const char *end) {
+	const char *q;
+	int rec[4], pos[2], i, last = 0;
+	/* check it all before inserting anything */
+	for (q = p; q < end; q += (size_t) rec[3] * sizeof pos) {
+		if ((size_t) (end - q) < sizeof rec) return FALSE;
+		memcpy(rec, q, sizeof rec);
+		q += sizeof rec;
+		if (rec[0] <= last || rec[0] > symCount() || rec[3] < 1 ||
+			(size_t) rec[3] > (size_t) (end - q) / sizeof pos)
+			return FALSE;
+		last = rec[0];
+	}
+	while (p < end) {
+		memcpy(rec, p, sizeof rec);
+		p += sizeof rec;
+		memcpy(pos, p, sizeof pos);
+		st_insert((SymId) rec[0], rec[1], pos[0], rec[2]);
+		if (findSym(rec[0]) == NULL) return FALSE;
+		for (i = 1; i < rec[3]; i++) {
+			memcpy(pos, p + i * sizeof pos, sizeof pos);
+			st_addline((SymId) rec[0], pos[0], pos[1]);
+		}
+		p += (size_t) rec[3] * sizeof pos;
+	}
+	return TRUE;
+}
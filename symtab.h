@@ -9,23 +9,62 @@
 #ifndef _SYMTAB_H_
 #define _SYMTAB_H_
 
-void symtabError(int lineno, char *message);
+/* Procedure symtabError reports message for the
+ * identifier at byte offset pos of the source
+ */
+void symtabError(int pos, char *message);
+
+/* Procedure st_insert inserts a variable with its
+ * type, the byte offset pos of its declaration and
+ * its memory location loc into the symbol table;
+ * a second declaration is reported as an error
+ */
+void st_insert(SymId sym, int type, int pos, int loc);
+
+/* the kinds of occurrence of a variable: its
+ * declaration and the statements that set it
+ * define it, expressions use it
+ */
+#define OCC_DEF 1
+#define OCC_USE 2
+
+/* Procedure st_addline records an occurrence of sym
+ * of the given kind at the position pos of the
+ * source (see sourceOffset)
+ */
+void st_addline(SymId sym, int pos, int kind);
 
-/* Procedure st_insert inserts line numbers and
- * memory locations into the symbol table
- * loc = memory location is inserted only the
- * first time, otherwise ignored
+/* Function st_resolve looks sym up once for its
+ * occurrence at pos: if it is declared, it records
+ * the occurrence as st_addline does and returns its
+ * type, else it returns -1
  */
-void st_insert(char *name, int type, int lineno, int loc);
+int st_resolve(SymId sym, int pos, int kind);
 
-void st_addline(char *name, int lineno);
+/* Procedure st_dropline forgets the use of sym at
+ * pos, and st_repos keeps it as the position to,
+ * which must stand for the same offset; declarations
+ * stay as they are
+ */
+void st_dropline(SymId sym, int pos);
+void st_repos(SymId sym, int pos, int to);
+
+/* Procedure st_clear empties the symbol table */
+void st_clear(void);
+
+/* Function st_occurrences returns the number of
+ * occurrences of sym of the kinds in mask on lines
+ * first to last, and stores the byte offsets of up
+ * to max of them in pos, in source order
+ */
+int st_occurrences(SymId sym, int mask, int first, int last, int *pos, int max);
 
 /* Function st_lookup returns the memory 
  * location of a variable or -1 if not found
  */
-int st_lookup(char *name);
+int st_lookup(SymId sym);
 
-int st_gettype(char *name);
+int st_gettype(SymId sym);
 
 /* Procedure printSymTab prints a formatted 
  * listing of the symbol table contents 
@@ -33,4 +72,20 @@ int st_gettype(char *name);
  */
 void printSymTab(FILE *listing);
 
+/* Procedure printXref lists the lines sym is
+ * defined (declared, read or assigned) and used on,
+ * from line first to last (INT_MAX for no end), as
+ * the occurrence index gives them
+ */
+void printXref(FILE *listing, SymId sym, int first, int last);
+
+/* Procedure st_save writes the symbol table to f
+ * for st_restore, which rebuilds it from the bytes
+ * [p, end) once the names are interned again as they
+ * were; st_restore returns FALSE, changing nothing,
+ * if the bytes do not make a table of those names
+ */
+void st_save(FILE *f);
+int st_restore(const char *p, const char *end);
+
 #endif
@@ -0,0 +1,549 @@
+/****************************************************/
+/* File: tree.c                                     */
+/* Construction and navigation of the compact       */
+/* syntax tree for the TINY compiler                */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "tree.h"
+#include "arena.h"
+
+/* POOLBLOCK is the number of parse nodes in a block
+   of the pool they are taken from */
+#define POOLBLOCK 4096
+
+typedef struct PoolBlockRec {
+	struct PoolBlockRec *next;
+	int used;
+	ParseNode node[POOLBLOCK];
+} PoolBlock;
+
+/* the pool, and the block nodes are taken from;
+   blocks are reused once a statement is packed.
+   Like the rest of the state below, each thread
+   building statements has its own. */
+static THREAD_LOCAL PoolBlock *pool = NULL, *block = NULL;
+
+/* records is the number of TreeNode records the
+   parse nodes taken since the last packing need */
+static THREAD_LOCAL unsigned records = 0;
+
+/* the records of the statements packed so far, and
+   the index of the last one */
+static THREAD_LOCAL TreeNode *packed = NULL;
+static THREAD_LOCAL unsigned npacked = 0, packedSize = 0, lastTop = 0;
+
+static ParseNode *newNode(NodeKind nodekind) {
+	ParseNode *t;
+	int i;
+	if (block == NULL || block->used == POOLBLOCK) {
+		PoolBlock *b = (block == NULL) ? pool : block->next;
+		if (b == NULL) {
+			b = (PoolBlock *) malloc(sizeof(PoolBlock));
+			if (b == NULL) {
+				fprintf(listing, "Out of memory error at line %d\n", lineno);
+				return NULL;
+			}
+			b->next = NULL;
+			if (block == NULL)
+				pool = b;
+			else
+				block->next = b;
+		}
+		b->used = 0;
+		block = b;
+	}
+	t = &block->node[block->used++];
+	for (i = 0; i < MAXCHILDREN; i++) t->child[i] = NULL;
+	t->sibling = NULL;
+	t->pos = tokenpos;
+	t->nodekind = nodekind;
+	t->attr.val = 0;
+	t->text = NULL;
+	records++;
+	return t;
+}
+
+ParseNode *newStmtNode(StmtKind kind) {
+	ParseNode *t = newNode(StmtK);
+	if (t != NULL) t->kind.stmt = kind;
+	return t;
+}
+
+ParseNode *newExpNode(ExpKind kind) {
+	ParseNode *t = newNode(ExpK);
+	if (t != NULL) t->kind.exp = kind;
+	return t;
+}
+
+int setNodeText(ParseNode *t, const char *s, int len) {
+	t->text = (char *) malloc(len + 1);
+	if (t->text == NULL) {
+		fprintf(listing, "Out of memory error at line %d\n", lineno);
+		return FALSE;
+	}
+	memcpy(t->text, s, len);
+	t->text[len] = '\0';
+	t->attr.val = len;
+	records += textRecords(len);
+	return TRUE;
+}
+
+/* recyclePool frees the texts of the parse nodes
+   taken so far and makes their blocks free again */
+static void recyclePool(void) {
+	PoolBlock *b;
+	for (b = pool; b != NULL; b = b->next) {
+		int i;
+		for (i = 0; i < b->used; i++) free(b->node[i].text);
+		b->used = 0;
+		if (b == block) break;
+	}
+	block = NULL;
+	records = 0;
+}
+
+/* With ShareExps, an operator expression is looked
+   up, once laid out, in a table of those laid out
+   before it in the same straight-line stretch of
+   code, keyed on its operator and operands. An
+   operand is a variable at its current version, a
+   constant, or the index of an operator expression;
+   assigning or reading a variable makes a new
+   version of it, and each if, while or repeat ends
+   the stretch by starting a new generation of the
+   table. */
+typedef struct {
+	unsigned kind; /* ExpKind, or RefK for none */
+	unsigned a, b; /* index; sym and version; value */
+} Operand;
+
+typedef struct {
+	unsigned gen;	/* entry is empty unless shareGen */
+	unsigned index; /* of the expression in packed */
+	unsigned op;
+	Operand x, y;
+} ShareEntry;
+
+static THREAD_LOCAL ShareEntry *share = NULL;
+static THREAD_LOCAL unsigned shareSize = 0, shareCount = 0, shareGen = 1;
+
+/* the current version of each variable by symbol id */
+static THREAD_LOCAL unsigned *version = NULL;
+static THREAD_LOCAL unsigned versionSize = 0;
+
+/* newStretch starts a new straight-line stretch */
+#define newStretch() (shareGen++, shareCount = 0)
+
+/* newVersion makes a new version of sym */
+static void newVersion(SymId sym) {
+	if (sym >= versionSize) {
+		unsigned n = versionSize ? 2 * versionSize : 1024, *p;
+		while (n <= sym) n *= 2;
+		p = (unsigned *) realloc(version, n * sizeof(unsigned));
+		if (p == NULL) {
+			/* without versions nothing may be shared */
+			ShareExps = FALSE;
+			return;
+		}
+		memset(p + versionSize, 0, (n - versionSize) * sizeof(unsigned));
+		version = p;
+		versionSize = n;
+	}
+	version[sym]++;
+}
+
+/* operand fills x with the operand the record c
+   is, and returns FALSE if it cannot be shared */
+static int operand(TreeNode *base, TreeNode *c, Operand *x) {
+	x->kind = c->kind.exp;
+	x->b = 0;
+	switch (c->kind.exp) {
+		case RefK:
+			c -= c->attr.val;
+			x->kind = OpK;
+			/* fall through */
+		case OpK:
+			x->a = (unsigned) (c - base);
+			return TRUE;
+		case IdK:
+			x->a = c->attr.sym;
+			x->b = (c->attr.sym < versionSize) ? version[c->attr.sym] : 0;
+			return TRUE;
+		case ConstK:
+		case BoolK:
+			x->a = (unsigned) c->attr.val;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+#define sameOperand(p, q) ((p).kind == (q).kind && (p).a == (q).a && (p).b == (q).b)
+
+static unsigned shareHash(unsigned op, const Operand *x, const Operand *y) {
+	unsigned h = op;
+	h = h * 2654435761u + x->kind;
+	h = h * 2654435761u + x->a;
+	h = h * 2654435761u + x->b;
+	h = h * 2654435761u + y->kind;
+	h = h * 2654435761u + y->a;
+	h = h * 2654435761u + y->b;
+	return h ^ (h >> 15);
+}
+
+/* growShare doubles the table, keeping the entries
+   of the current stretch; FALSE if out of memory */
+static int growShare(void) {
+	unsigned n = shareSize ? 2 * shareSize : 1024, i, j;
+	ShareEntry *p = (ShareEntry *) calloc(n, sizeof(ShareEntry));
+	if (p == NULL) return FALSE;
+	for (i = 0; i < shareSize; i++)
+		if (share[i].gen == shareGen) {
+			ShareEntry *e = &share[i];
+			j = shareHash(e->op, &e->x, &e->y) & (n - 1);
+			while (p[j].gen == shareGen) j = (j + 1) & (n - 1);
+			p[j] = *e;
+		}
+	free(share);
+	share = p;
+	shareSize = n;
+	return TRUE;
+}
+
+/* shareExp looks up the operator expression t, laid
+   out in base up to out; if it was met before, t
+   becomes a RefK to it. It returns the new end. */
+static TreeNode *shareExp(TreeNode *base, TreeNode *t, TreeNode *out) {
+	Operand x, y;
+	unsigned i;
+	TreeNode *c = t + 1;
+	if (!(t->flags & CHILD(0)) || !operand(base, c, &x)) return out;
+	y.kind = RefK;
+	y.a = y.b = 0;
+	if (t->flags & CHILD(1)) {
+		if (!operand(base, c + c->size, &y)) return out;
+	} else if (t->attr.op != NOT)
+		return out;
+	if (2 * (shareCount + 1) > shareSize && !growShare()) return out;
+	for (i = shareHash(t->attr.op, &x, &y) & (shareSize - 1); share[i].gen == shareGen;
+		 i = (i + 1) & (shareSize - 1)) {
+		ShareEntry *e = &share[i];
+		if (e->op == (unsigned) t->attr.op && sameOperand(e->x, x) && sameOperand(e->y, y)) {
+			TreeNode *f = base + e->index;
+			f->flags |= SHARED;
+			t->kind.exp = RefK;
+			t->flags &= SIBLING;
+			t->attr.val = (int) (t - f);
+			t->size = 1;
+			return t + 1;
+		}
+	}
+	share[i].gen = shareGen;
+	share[i].index = (unsigned) (t - base);
+	share[i].op = t->attr.op;
+	share[i].x = x;
+	share[i].y = y;
+	shareCount++;
+	return out;
+}
+
+/* freeShare frees the table and the versions */
+static void freeShare(void) {
+	free(share);
+	free(version);
+	share = NULL;
+	version = NULL;
+	shareSize = shareCount = versionSize = 0;
+	newStretch();
+}
+
+/* PackFrame is a node being laid out whose children
+   from slot on are still to come */
+typedef struct {
+	ParseNode *p;
+	TreeNode *t;
+	int slot;
+} PackFrame;
+
+/* the stack of nodes being laid out */
+static THREAD_LOCAL PackFrame *frame = NULL;
+static THREAD_LOCAL int frameSize = 0;
+
+/* structured is TRUE for the record of an if,
+   while or repeat, whose parts end stretches */
+#define structured(t) ((t)->nodekind == StmtK && \
+	((t)->kind.stmt == IfK || (t)->kind.stmt == WhileK || (t)->kind.stmt == RepeatK))
+
+/* packChain lays out the chain of siblings starting
+   at p from out on, in preorder, and returns the
+   record after it, or NULL if out of memory; it
+   keeps a stack of its own, as deep as the tree.
+   Expressions are shared within the records from
+   base on, unless base is NULL. */
+static TreeNode *packChain(ParseNode *p, TreeNode *out, TreeNode *base) {
+	int depth = 0;
+	for (;;) {
+		/* lay out the record of p */
+		TreeNode *t = out++;
+		t->nodekind = (unsigned char) p->nodekind;
+		t->kind.stmt = (unsigned char) p->kind.stmt;
+		t->type = Void;
+		t->flags = (p->sibling != NULL) ? SIBLING : 0;
+		t->pos = p->pos;
+		t->attr.val = p->attr.val;
+		if (p->text != NULL) {
+			/* the text is padded with zeros to whole records */
+			memset(out, 0, textRecords(p->attr.val) * sizeof(TreeNode));
+			memcpy(out, p->text, p->attr.val + 1);
+			out += textRecords(p->attr.val);
+		}
+		if (depth == frameSize) {
+			int n = frameSize ? 2 * frameSize : 64;
+			PackFrame *f = (PackFrame *) realloc(frame, n * sizeof(PackFrame));
+			if (f == NULL) return NULL;
+			frame = f;
+			frameSize = n;
+		}
+		frame[depth].p = p;
+		frame[depth].t = t;
+		frame[depth].slot = 0;
+		depth++;
+		if (base != NULL && structured(t)) newStretch();
+		/* find the next node: a child of the innermost
+		   open node, or the sibling of one just done */
+		for (;;) {
+			PackFrame *f = &frame[depth - 1];
+			while (f->slot < MAXCHILDREN && f->p->child[f->slot] == NULL) f->slot++;
+			if (f->slot < MAXCHILDREN) {
+				f->t->flags |= CHILD(f->slot);
+				p = f->p->child[f->slot++];
+				if (base != NULL && structured(f->t)) newStretch();
+				break;
+			}
+			f->t->size = (unsigned int) (out - f->t);
+			depth--;
+			if (base != NULL) {
+				if (f->t->nodekind == ExpK && f->t->kind.exp == OpK)
+					out = shareExp(base, f->t, out);
+				else if (structured(f->t))
+					newStretch();
+				else if (f->t->nodekind == StmtK &&
+						 (f->t->kind.stmt == AssignK || f->t->kind.stmt == ReadK))
+					newVersion(f->t->attr.sym);
+			}
+			if (f->p->sibling != NULL) {
+				p = f->p->sibling;
+				break;
+			}
+			if (depth == 0) return out;
+		}
+	}
+}
+
+void appendStatement(ParseNode *t) {
+	TreeNode *end;
+	if (npacked + records > packedSize) {
+		unsigned n = packedSize ? 2 * packedSize : 4096;
+		TreeNode *p;
+		while (n < npacked + records) n *= 2;
+		p = (TreeNode *) realloc(packed, n * sizeof(TreeNode));
+		if (p == NULL) {
+			fprintf(listing, "Out of memory error at line %d\n", lineno);
+			Error = TRUE;
+			recyclePool();
+			return;
+		}
+		packed = p;
+		packedSize = n;
+	}
+	t->sibling = NULL;
+	end = packChain(t, packed + npacked, ShareExps ? packed : NULL);
+	if (end == NULL) {
+		fprintf(listing, "Out of memory error at line %d\n", lineno);
+		Error = TRUE;
+	} else {
+		if (npacked > 0) packed[lastTop].flags |= SIBLING;
+		lastTop = npacked;
+		npacked = (unsigned) (end - packed);
+	}
+	recyclePool();
+}
+
+void takeStatements(StatementRun *run) {
+	PoolBlock *b, *next;
+	run->rec = packed;
+	run->count = npacked;
+	run->last = lastTop;
+	packed = NULL;
+	npacked = packedSize = lastTop = 0;
+	free(frame);
+	frame = NULL;
+	frameSize = 0;
+	recyclePool();
+	for (b = pool; b != NULL; b = next) {
+		next = b->next;
+		free(b);
+	}
+	pool = NULL;
+	freeShare();
+}
+
+void appendRun(StatementRun *run) {
+	if (run->count > 0 && !Error) {
+		if (npacked + run->count > packedSize) {
+			unsigned n = packedSize ? 2 * packedSize : 4096;
+			TreeNode *p;
+			while (n < npacked + run->count) n *= 2;
+			p = (TreeNode *) realloc(packed, n * sizeof(TreeNode));
+			if (p == NULL) {
+				fprintf(listing, "Out of memory error at line %d\n", lineno);
+				Error = TRUE;
+				free(run->rec);
+				return;
+			}
+			packed = p;
+			packedSize = n;
+		}
+		memcpy(packed + npacked, run->rec, run->count * sizeof(TreeNode));
+		if (npacked > 0) packed[lastTop].flags |= SIBLING;
+		lastTop = npacked + run->last;
+		npacked += run->count;
+	}
+	free(run->rec);
+}
+
+/* the records of layoutNode, reused on each call */
+static THREAD_LOCAL TreeNode *scratch = NULL;
+static THREAD_LOCAL unsigned scratchSize = 0;
+
+TreeNode *layoutNode(ParseNode *t) {
+	TreeNode *end = NULL;
+	if (records > scratchSize) {
+		unsigned n = scratchSize ? 2 * scratchSize : 256;
+		TreeNode *p;
+		while (n < records) n *= 2;
+		p = (TreeNode *) realloc(scratch, n * sizeof(TreeNode));
+		if (p != NULL) {
+			scratch = p;
+			scratchSize = n;
+		}
+	}
+	if (records <= scratchSize) {
+		t->sibling = NULL;
+		end = packChain(t, scratch, NULL);
+	}
+	recyclePool();
+	if (end == NULL) {
+		fprintf(listing, "Out of memory error at line %d\n", lineno);
+		Error = TRUE;
+		return NULL;
+	}
+	return scratch;
+}
+
+TreeNode *finishTree(void) {
+	TreeNode *tree = NULL;
+	if (npacked > 0) {
+		/* the arena takes the array over as it is */
+		tree = (TreeNode *) realloc(packed, npacked * sizeof(TreeNode));
+		if (tree == NULL) tree = packed;
+		if (!arenaAdopt(tree)) {
+			fprintf(listing, "Out of memory error at line %d\n", lineno);
+			Error = TRUE;
+			free(tree);
+			tree = NULL;
+		}
+	} else
+		free(packed);
+	recyclePool();
+	freeShare();
+	free(frame);
+	free(scratch);
+	frame = NULL;
+	frameSize = 0;
+	scratch = NULL;
+	scratchSize = 0;
+	packed = NULL;
+	npacked = packedSize = lastTop = 0;
+	return tree;
+}
+
+TreeNode *chainEnd(TreeNode *t) {
+	while (t->flags & SIBLING) t += t->size;
+	return t + t->size;
+}
+
+TreeNode *nodeChild(TreeNode *t, int i) {
+	TreeNode *c = t + 1;
+	int k;
+	if (!(t->flags & CHILD(i))) return NULL;
+	for (k = 0; k < i; k++)
+		if (t->flags & CHILD(k)) c = chainEnd(c);
+	return c;
+}
+
+/* WalkFrame is a node on the path of walkTree: slot
+   is the child slot being walked, last the child
+   last entered in it, and next the record where the
+   chain of the next filled slot starts */
+typedef struct {
+	TreeNode *t;
+	int slot;
+	TreeNode *last, *next;
+} WalkFrame;
+
+void walkTree(TreeNode *t, const TreeVisitor *v) {
+	WalkFrame *stack = NULL;
+	int depth = 0, size = 0;
+	for (; t != NULL; t = nodeSibling(t)) {
+		TreeNode *c = t; /* the node to enter next */
+		for (;;) {
+			WalkFrame *f;
+			if (c != NULL) {
+				if (v->pre != NULL) v->pre(c);
+				if (depth == size) {
+					int n = size ? 2 * size : 64;
+					WalkFrame *p = (WalkFrame *) realloc(stack, n * sizeof(WalkFrame));
+					if (p == NULL) {
+						fprintf(listing, "Out of memory error\n");
+						Error = TRUE;
+						free(stack);
+						return;
+					}
+					stack = p;
+					size = n;
+				}
+				stack[depth].t = c;
+				stack[depth].slot = 0;
+				stack[depth].last = NULL;
+				stack[depth].next = c + 1;
+				depth++;
+				c = NULL;
+			}
+			f = &stack[depth - 1];
+			if (f->last != NULL) {
+				/* the subtree of last is done */
+				if (f->last->flags & SIBLING) {
+					c = f->last = f->last + f->last->size;
+					continue;
+				}
+				f->next = f->last + f->last->size;
+				f->last = NULL;
+				if (v->in != NULL) v->in(f->t, f->slot);
+				f->slot++;
+			} else if (f->slot == MAXCHILDREN) {
+				if (v->post != NULL) v->post(f->t);
+				if (--depth == 0) break;
+			} else if (f->t->flags & CHILD(f->slot))
+				c = f->last = f->next;
+			else {
+				if (v->in != NULL) v->in(f->t, f->slot);
+				f->slot++;
+			}
+		}
+	}
+	free(stack);
+}
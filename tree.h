@@ -0,0 +1,127 @@
+/****************************************************/
+/* File: tree.h                                     */
+/* Construction and navigation of the compact       */
+/* syntax tree for the TINY compiler                */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _TREE_H_
+#define _TREE_H_
+
+/* ParseNode is the node the parser builds: linked by
+ * pointers, in the order the parser meets the nodes.
+ * Each top-level statement is laid out as TreeNode
+ * records in preorder once it is complete, and its
+ * parse nodes are reused for the next one.
+ */
+typedef struct parseNode {
+	struct parseNode *child[MAXCHILDREN];
+	struct parseNode *sibling;
+	int pos;
+	NodeKind nodekind;
+	union {
+		StmtKind stmt;
+		ExpKind exp;
+	} kind;
+	union {
+		TokenType op;
+		int val;
+		SymId sym;
+	} attr;
+	char *text; /* text of a StrK */
+} ParseNode;
+
+/* Function newStmtNode creates a new statement
+ * node for syntax tree construction
+ */
+ParseNode *newStmtNode(StmtKind);
+
+/* Function newExpNode creates a new expression 
+ * node for syntax tree construction
+ */
+ParseNode *newExpNode(ExpKind);
+
+/* Function setNodeText gives the StrK node t a copy
+ * of the text s of length len; FALSE if out of memory
+ */
+int setNodeText(ParseNode *t, const char *s, int len);
+
+/* Procedure appendStatement lays out the statement
+ * t, a whole tree of parse nodes, after the
+ * statements of the program laid out so far; every
+ * parse node taken so far is then reused
+ */
+void appendStatement(ParseNode *t);
+
+/* StatementRun holds top-level statements laid
+ * out by one thread: count records, the last
+ * statement starting at index last
+ */
+typedef struct {
+	TreeNode *rec;
+	unsigned count, last;
+} StatementRun;
+
+/* Procedure takeStatements moves the statements
+ * this thread has laid out so far into run, and
+ * frees the thread's parse nodes; appendRun lays
+ * out the statements of run after those of this
+ * thread, in order, and frees run
+ */
+void takeStatements(StatementRun *run);
+void appendRun(StatementRun *run);
+
+/* Function layoutNode lays out the tree of parse
+ * nodes t on its own, in records that stay valid
+ * until the next call, and reuses every parse node
+ * taken so far; NULL if out of memory. It serves
+ * one-pass mode, which builds no program tree.
+ */
+TreeNode *layoutNode(ParseNode *t);
+
+/* Function finishTree hands the statements laid out
+ * over to the compilation arena and returns the root
+ * of the tree, NULL for an empty program
+ */
+TreeNode *finishTree(void);
+
+/* Function chainEnd returns the record that follows
+ * the chain of siblings starting at t
+ */
+TreeNode *chainEnd(TreeNode *t);
+
+/* Function nodeChild returns child i of t, or NULL
+ * if that slot is empty
+ */
+TreeNode *nodeChild(TreeNode *t, int i);
+
+/* TreeVisitor holds the actions of a walk over the
+ * tree: pre on reaching a node, in after each of its
+ * child slots, filled or not, and post after all of
+ * them; any may be NULL
+ */
+typedef struct {
+	void (*pre)(TreeNode *);
+	void (*in)(TreeNode *, int);
+	void (*post)(TreeNode *);
+} TreeVisitor;
+
+/* Procedure walkTree walks the chain of nodes
+ * starting at t and everything below it, applying
+ * the actions of v. It keeps a stack of its own, as
+ * deep as the nesting of the tree, and loops over
+ * siblings, so the C stack stays flat.
+ */
+void walkTree(TreeNode *t, const TreeVisitor *v);
+
+/* nodeSibling is the next sibling of t, or NULL;
+ * nodeText is the NUL-terminated text of a StrK, and
+ * textRecords the number of records text of length
+ * len takes up after it
+ */
+#define nodeSibling(t) (((t)->flags & SIBLING) ? (t) + (t)->size : NULL)
+#define nodeText(t) ((char *) ((t) + 1))
+#define textRecords(len) (((len) + sizeof(TreeNode)) / sizeof(TreeNode))
+
+#endif
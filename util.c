@@ -8,11 +8,16 @@
 
 #include "globals.h"
 #include "util.h"
+#include "tree.h"
+#include "intern.h"
 
-/* Procedure printToken prints a token 
- * and its lexeme to the listing file
+/* kind of the last lexical error, set by the scanner */
+int errortype;
+
+/* Procedure printToken prints a token and its
+ * lexeme of the given length to the listing file
  */
-void printToken(TokenType token, const char *tokenString) {
+void printToken(TokenType token, const char *tokenString, int len) {
 	char *err;
 	static int i;
 	switch (token) {
@@ -35,7 +40,7 @@ void printToken(TokenType token, const char *tokenString) {
 		case WHILE:
 		case DO:
 			fprintf(listing,
-				"(KEY,%s)\n", tokenString);
+				"(KEY,%.*s)\n", len, tokenString);
 			break;
 		case ASSIGN:
 		case LT:
@@ -52,18 +57,18 @@ void printToken(TokenType token, const char *tokenString) {
 		case TIMES:
 		case OVER:
 			fprintf(listing,
-				"(SYM,%s)\n", tokenString);
+				"(SYM,%.*s)\n", len, tokenString);
 			break;
 		case NUM:
 			fprintf(listing,
-				"(NUM,%s)\n", tokenString);
+				"(NUM,%.*s)\n", len, tokenString);
 			break;
 		case ID:
 			fprintf(listing,
-				"(ID,%s)\n", tokenString);
+				"(ID,%.*s)\n", len, tokenString);
 			break;
 		case STR:
-			fprintf(listing, "(STR,%s)\n", tokenString);
+			fprintf(listing, "(STR,%.*s)\n", len, tokenString);
 			break;
 		case ENDFILE:
 			fprintf(listing, "(EOF)\n");
@@ -83,64 +88,11 @@ void printToken(TokenType token, const char *tokenString) {
 					err = "unknown lexical error";
 			}
 			fprintf(listing,
-				"Lexical error: %s: \"%s\"\n", err, tokenString);
+				"Lexical error: %s: \"%.*s\"\n", err, len, tokenString);
 			break;
 	}
 }
 
-/* Function newStmtNode creates a new statement
- * node for syntax tree construction
- */
-TreeNode *newStmtNode(StmtKind kind) {
-	TreeNode *t = (TreeNode *) malloc(sizeof(TreeNode));
-	int i;
-	if (t == NULL)
-		fprintf(listing, "Out of memory error at line %d\n", lineno);
-	else {
-		for (i = 0; i < MAXCHILDREN; i++) t->child[i] = NULL;
-		t->sibling = NULL;
-		t->nodekind = StmtK;
-		t->kind.stmt = kind;
-		t->lineno = lineno;
-	}
-	return t;
-}
-
-/* Function newExpNode creates a new expression 
- * node for syntax tree construction
- */
-TreeNode *newExpNode(ExpKind kind) {
-	TreeNode *t = (TreeNode *) malloc(sizeof(TreeNode));
-	int i;
-	if (t == NULL)
-		fprintf(listing, "Out of memory error at line %d\n", lineno);
-	else {
-		for (i = 0; i < MAXCHILDREN; i++) t->child[i] = NULL;
-		t->sibling = NULL;
-		t->nodekind = ExpK;
-		t->kind.exp = kind;
-		t->lineno = lineno;
-		t->type = Void;
-	}
-	return t;
-}
-
-/* Function copyString allocates and makes a new
- * copy of an existing string
- */
-char *copyString(char *s) {
-	int n;
-	char *t;
-	if (s == NULL) return NULL;
-	n = strlen(s) + 1;
-	t = malloc(n);
-	if (t == NULL)
-		fprintf(listing, "Out of memory error at line %d\n", lineno);
-	else
-		strcpy(t, s);
-	return t;
-}
-
 /* Variable indentno is used by printTree to
  * store current number of spaces to indent
  */
@@ -157,107 +109,119 @@ static void printSpaces(void) {
 		fprintf(listing, " ");
 }
 
+/* printNode prints one node of the tree at the
+ * current indentation, which then grows for its
+ * children
+ */
+static void printNode(TreeNode *tree) {
+	printSpaces();
+	if (tree->nodekind == ExpK && tree->kind.exp == RefK) {
+		fprintf(listing, "Shared ");
+		tree -= tree->attr.val;
+	}
+	if (tree->nodekind == StmtK) {
+		switch (tree->kind.stmt) {
+			case IfK:
+				fprintf(listing, "If\n");
+				break;
+			case RepeatK:
+				fprintf(listing, "Repeat\n");
+				break;
+			case AssignK:
+				fprintf(listing, "Assign to: %s\n", symName(tree->attr.sym));
+				break;
+			case ReadK:
+				fprintf(listing, "Read: %s\n", symName(tree->attr.sym));
+				break;
+			case WriteK:
+				fprintf(listing, "Write\n");
+				break;
+			case WhileK:
+				fprintf(listing, "While\n");
+				break;
+			default:
+				fprintf(listing, "Unknown ExpNode kind\n");
+				break;
+		}
+	} else if (tree->nodekind == ExpK) {
+		char *tokenString;
+		switch (tree->kind.exp) {
+			case OpK:
+				fprintf(listing, "Op: ");
+				switch (tree->attr.op) {
+					case PLUS:
+						tokenString = "+";
+						break;
+					case MINUS:
+						tokenString = "-";
+						break;
+					case TIMES:
+						tokenString = "*";
+						break;
+					case OVER:
+						tokenString = "/";
+						break;
+					case AND:
+						tokenString = "and";
+						break;
+					case OR:
+						tokenString = "or";
+						break;
+					case NOT:
+						tokenString = "not";
+						break;
+					case LT:
+						tokenString = "<";
+						break;
+					case LE:
+						tokenString = "<=";
+						break;
+					case EQ:
+						tokenString = "=";
+						break;
+					case GT:
+						tokenString = ">";
+						break;
+					case GE:
+						tokenString = ">=";
+						break;
+				}
+				printToken(tree->attr.op, tokenString, strlen(tokenString));
+				break;
+			case ConstK:
+				fprintf(listing, "Const: %d\n", tree->attr.val);
+				break;
+			case IdK:
+				fprintf(listing, "Id: %s\n", symName(tree->attr.sym));
+				break;
+			case StrK:
+				fprintf(listing, "String: %s\n", nodeText(tree));
+				break;
+			case BoolK:
+				if (tree->attr.val == 1)
+					fprintf(listing, "Boolean: %s\n", "true");
+				else
+					fprintf(listing, "Boolean: %s\n", "false");
+				break;
+			default:
+				fprintf(listing, "Unknown ExpNode kind\n");
+				break;
+		}
+	} else
+		fprintf(listing, "Unknown node kind\n");
+	INDENT;
+}
+
+static void unindentNode(TreeNode *tree) {
+	UNINDENT;
+}
+
 /* procedure printTree prints a syntax tree to the 
  * listing file using indentation to indicate subtrees
  */
 void printTree(TreeNode *tree) {
-	int i;
+	TreeVisitor v = {printNode, NULL, unindentNode};
 	INDENT;
-	while (tree != NULL) {
-		printSpaces();
-		if (tree->nodekind == StmtK) {
-			switch (tree->kind.stmt) {
-				case IfK:
-					fprintf(listing, "If\n");
-					break;
-				case RepeatK:
-					fprintf(listing, "Repeat\n");
-					break;
-				case AssignK:
-					fprintf(listing, "Assign to: %s\n", tree->attr.name);
-					break;
-				case ReadK:
-					fprintf(listing, "Read: %s\n", tree->attr.name);
-					break;
-				case WriteK:
-					fprintf(listing, "Write\n");
-					break;
-				case WhileK:
-					fprintf(listing, "While\n");
-					break;
-				default:
-					fprintf(listing, "Unknown ExpNode kind\n");
-					break;
-			}
-		} else if (tree->nodekind == ExpK) {
-			char *tokenString;
-			switch (tree->kind.exp) {
-				case OpK:
-					fprintf(listing, "Op: ");
-					switch (tree->attr.op) {
-						case PLUS:
-							tokenString = "+";
-							break;
-						case MINUS:
-							tokenString = "-";
-							break;
-						case TIMES:
-							tokenString = "*";
-							break;
-						case OVER:
-							tokenString = "/";
-							break;
-						case AND:
-							tokenString = "and";
-							break;
-						case OR:
-							tokenString = "or";
-							break;
-						case NOT:
-							tokenString = "not";
-							break;
-						case LT:
-							tokenString = "<";
-							break;
-						case LE:
-							tokenString = "<=";
-							break;
-						case EQ:
-							tokenString = "=";
-							break;
-						case GT:
-							tokenString = ">";
-							break;
-						case GE:
-							tokenString = ">=";
-							break;
-					}
-					printToken(tree->attr.op, tokenString);
-					break;
-				case ConstK:
-					fprintf(listing, "Const: %d\n", tree->attr.val);
-					break;
-				case IdK:
-					fprintf(listing, "Id: %s\n", tree->attr.name);
-					break;
-				case StrK:
-					fprintf(listing, "String: %s\n", tree->attr.name);
-					break;
-				case BoolK:
-					if (tree->attr.val == 1)
-						fprintf(listing, "Boolean: %s\n", "true");
-					else
-						fprintf(listing, "Boolean: %s\n", "false");
-					break;
-				default:
-					fprintf(listing, "Unknown ExpNode kind\n");
-					break;
-			}
-		} else
-			fprintf(listing, "Unknown node kind\n");
-		for (i = 0; i < MAXCHILDREN; i++)
-			printTree(tree->child[i]);
-		tree = tree->sibling;
-	}
+	walkTree(tree, &v);
 	UNINDENT;
 }
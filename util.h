@@ -8,26 +8,11 @@
 #ifndef _UTIL_H_
 #define _UTIL_H_
 
-/* Procedure printToken prints a token 
- * and its lexeme to the listing file
+/* Procedure printToken prints a token and its
+ * lexeme of the given length to the listing file
  */
-void printToken(TokenType, const char *);
-int errortype;
-
-/* Function newStmtNode creates a new statement
- * node for syntax tree construction
- */
-TreeNode *newStmtNode(StmtKind);
-
-/* Function newExpNode creates a new expression 
- * node for syntax tree construction
- */
-TreeNode *newExpNode(ExpKind);
-
-/* Function copyString allocates and makes a new
- * copy of an existing string
- */
-char *copyString(char *);
+void printToken(TokenType, const char *, int);
+extern int errortype;
 
 /* procedure printTree prints a syntax tree to the 
  * listing file using indentation to indicate subtrees